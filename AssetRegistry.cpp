@@ -0,0 +1,74 @@
+#include "AssetRegistry.h"
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <common/asyncloader.h>
+
+using namespace std;
+
+// Forget the assets whose last handle is gone
+template <typename T>
+static void prune(map<string, weak_ptr<T>>& assets) {
+    for (auto it = assets.begin(); it != assets.end();) {
+        if (it->second.expired()) it = assets.erase(it);
+        else ++it;
+    }
+}
+
+string AssetRegistry::canonicalPath(const string& path) {
+    error_code error;
+    filesystem::path absolute = filesystem::absolute(path, error);
+    filesystem::path canonical = filesystem::weakly_canonical(absolute, error);
+    if (error) canonical = absolute.lexically_normal();
+    return canonical.generic_string();
+}
+
+MeshHandle AssetRegistry::mesh(const string& path, bool optimize, VertexFormat format, AsyncLoader* loader,
+                               Residency residency) {
+    prune(meshes);
+    // the GPU data depends on the load options too, and users of the CPU arrays need them kept
+    static const char* residencyKeys[] = {"", "|dropped", "|collision"};
+    string key = canonicalPath(path) + (optimize ? "|optimized" : "") +
+                 (format == VERTEX_QUANTIZED ? "|quantized" : "") + residencyKeys[residency];
+    if (MeshHandle existing = meshes[key].lock()) {
+        shared++;
+        return existing;
+    }
+    MeshHandle mesh(loader ? new Drawable(path, *loader, optimize, format, residency)
+                           : new Drawable(path, optimize, format, residency));
+    meshes[key] = mesh;
+    return mesh;
+}
+
+TextureHandle AssetRegistry::texture(const string& path, AsyncLoader* loader) {
+    prune(textures);
+    string key = canonicalPath(path);
+    if (TextureHandle existing = textures[key].lock()) {
+        shared++;
+        return existing;
+    }
+    GLuint name = loader ? loader->loadTexture(path) : loadSOIL(path.c_str());
+    if (!name) throw runtime_error("Failed to load texture: " + path);
+    TextureHandle texture = make_shared<const TextureAsset>(name);
+    textures[key] = texture;
+    return texture;
+}
+
+size_t AssetRegistry::meshCount() {
+    prune(meshes);
+    return meshes.size();
+}
+
+size_t AssetRegistry::textureCount() {
+    prune(textures);
+    return textures.size();
+}
+
+size_t AssetRegistry::meshHostMemoryBytes() {
+    prune(meshes);
+    size_t bytes = 0;
+    for (const auto& entry : meshes) {
+        if (MeshHandle mesh = entry.second.lock()) bytes += mesh->hostMemoryBytes();
+    }
+    return bytes;
+}
@@ -0,0 +1,48 @@
+#ifndef ASSET_REGISTRY_H
+#define ASSET_REGISTRY_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include "model.h"
+#include "texture.h"
+
+class AsyncLoader;
+
+using MeshHandle = std::shared_ptr<Drawable>;
+using TextureHandle = std::shared_ptr<const TextureAsset>;
+
+/**
+* Shares meshes and textures between their users. Assets are keyed by
+* canonical path (and the load options of meshes), so asking twice for
+* "earth.obj" parses and uploads it once. Handles are reference counted:
+* an asset is deleted when its last handle goes, on that thread, which
+* must be the GL thread. The registry only observes the assets, it can be
+* destroyed before them.
+*/
+class AssetRegistry {
+public:
+    /* With a loader the mesh loads in the background, see Drawable */
+    MeshHandle mesh(const std::string& path, bool optimize = true, VertexFormat format = VERTEX_FLOAT,
+                    AsyncLoader* loader = nullptr, Residency residency = RESIDENCY_KEEP);
+
+    /* With a loader the texture is a placeholder until streamed. Throws if it can't be loaded */
+    TextureHandle texture(const std::string& path, AsyncLoader* loader = nullptr);
+
+    /* Assets alive, and requests served by one that already was */
+    size_t meshCount();
+    size_t textureCount();
+    unsigned int sharedRequests() const { return shared; }
+    /* Heap bytes held by the live meshes */
+    size_t meshHostMemoryBytes();
+
+    /* Absolute, normalized and with symbolic links resolved as far as the path exists */
+    static std::string canonicalPath(const std::string& path);
+
+private:
+    std::map<std::string, std::weak_ptr<Drawable>> meshes;
+    std::map<std::string, std::weak_ptr<const TextureAsset>> textures;
+    unsigned int shared = 0;
+};
+
+#endif
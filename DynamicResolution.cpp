@@ -0,0 +1,80 @@
+#include "DynamicResolution.h"
+#include <common/shader.h>
+#include <algorithm>
+#include <cmath>
+
+// scale errors below this are ignored
+const float DEAD_BAND = 0.02f;
+// fraction of the error corrected per frame
+const float SMOOTHING = 0.2f;
+
+DynamicResolution::DynamicResolution(int width, int height)
+        : targetMs(8.0f), scale(1.0f), minScale(0.5f), maxScale(1.0f) {
+    target = createRenderTarget(width, height);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // the upscale filters the color bilinearly
+    glBindTexture(GL_TEXTURE_2D, target.color);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    upscaleProgram = loadShaders(
+        "FullscreenTriangle.vertexshader",
+        "Upscale.fragmentshader");
+    colorLocation = glGetUniformLocation(upscaleProgram, "sceneColor");
+    uvScaleLocation = glGetUniformLocation(upscaleProgram, "uvScale");
+    uvMaxLocation = glGetUniformLocation(upscaleProgram, "uvMax");
+}
+
+DynamicResolution::~DynamicResolution() {
+    deleteRenderTarget(target);
+    glDeleteProgram(upscaleProgram);
+}
+
+void DynamicResolution::setScaleRange(float newMin, float newMax) {
+    minScale = std::max(0.1f, std::min(newMin, 1.0f));
+    maxScale = std::max(minScale, std::min(newMax, 1.0f));
+    scale = std::max(minScale, std::min(scale, maxScale));
+}
+
+void DynamicResolution::update(float gpuMs) {
+    // no measurement yet
+    if (gpuMs <= 0.0f || targetMs <= 0.0f) return;
+
+    // pixels, and so the cost, grow with the square of the scale
+    float desired = scale * std::sqrt(targetMs / gpuMs);
+    desired = std::max(minScale, std::min(desired, maxScale));
+    if (std::fabs(desired - scale) > DEAD_BAND) {
+        scale += (desired - scale) * SMOOTHING;
+    }
+}
+
+int DynamicResolution::viewportWidth() const {
+    return std::max(1, std::min(target.width, (int) (target.width * scale + 0.5f)));
+}
+
+int DynamicResolution::viewportHeight() const {
+    return std::max(1, std::min(target.height, (int) (target.height * scale + 0.5f)));
+}
+
+void DynamicResolution::upscale(GLuint outputFramebuffer) {
+    float width = (float) viewportWidth(), height = (float) viewportHeight();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+    glViewport(0, 0, target.width, target.height);
+    GLboolean blend = glIsEnabled(GL_BLEND);
+    glDisable(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+
+    glUseProgram(upscaleProgram);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, target.color);
+    glUniform1i(colorLocation, 0);
+    glUniform2f(uvScaleLocation, width / target.width, height / target.height);
+    // half a texel inside the viewport, the filter never reads what is outside it
+    glUniform2f(uvMaxLocation, (width - 0.5f) / target.width, (height - 0.5f) / target.height);
+    drawFullscreenTriangle();
+
+    glEnable(GL_DEPTH_TEST);
+    if (blend) glEnable(GL_BLEND);
+}
@@ -0,0 +1,50 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <GL/glew.h>
+#include <common/framebuffer.h>
+
+/**
+* Renders the scene into an offscreen target at a fraction of the output
+* resolution and upscales it, so the GPU time of the scene stays close to a
+* target.
+*
+* The target is allocated once at the output size and the scene is drawn
+* into its bottom-left viewportWidth() x viewportHeight() corner, changing
+* the scale never reallocates anything. update() moves the scale towards the
+* one that would meet the target, assuming the cost is proportional to the
+* number of pixels. The measured times lag a few frames behind (the profiler
+* reads its queries late), so the scale moves in damped steps and ignores
+* errors within a dead band to avoid oscillating.
+*
+* The target is single-sampled, the scene loses the multisampling of the
+* window while it is rendered through here.
+*/
+class DynamicResolution {
+public:
+    DynamicResolution(int width, int height);
+    ~DynamicResolution();
+
+    void setTargetFrameTime(float ms) { targetMs = ms; }
+    float getTargetFrameTime() const { return targetMs; }
+    void setScaleRange(float minScale, float maxScale);
+    float getScale() const { return scale; }
+
+    /* GPU time of the resolution dependent passes of the last measured frame */
+    void update(float gpuMs);
+
+    GLuint framebuffer() const { return target.framebuffer; }
+    int viewportWidth() const;
+    int viewportHeight() const;
+
+    /* Bilinear upscale of the rendered viewport to the whole output framebuffer.
+     * Changes the bound program and texture unit 0 */
+    void upscale(GLuint outputFramebuffer = 0);
+
+private:
+    RenderTarget target;
+    float targetMs, scale, minScale, maxScale;
+    GLuint upscaleProgram, colorLocation, uvScaleLocation, uvMaxLocation;
+};
+
+#endif
@@ -0,0 +1,237 @@
+#include "EmitterManager.h"
+#include <common/frustum.h>
+#include <algorithm>
+#include <cmath>
+
+//cellKey uses 63 bits, so no cell has this key
+static const long long NO_CELL = -1;
+
+//Replaces value with replacement in an unordered list of indices
+static void replaceIndex(std::vector<int>& list, int value, int replacement) {
+	auto it = std::find(list.begin(), list.end(), value);
+	if (it == list.end()) return;
+	if (replacement < 0) {
+		*it = list.back();
+		list.pop_back();
+	} else {
+		*it = replacement;
+	}
+}
+
+EmitterManager::EmitterManager(float cell_size) : cell_size(cell_size) {}
+
+void EmitterManager::addEmitter(IntParticleEmitter* emitter, float radius) {
+	if (entry_index.count(emitter)) return;
+
+	EmitterEntry entry;
+	entry.emitter = emitter;
+	entry.radius = radius;
+	entry.local_min = glm::vec3(-radius);
+	entry.local_max = glm::vec3(radius);
+	entry.awake = false;
+	entry.dirty = true;
+	entry.behind = true;
+	entry.last_update = 0.0f;
+	entry.cell = NO_CELL;
+
+	entry_index[emitter] = (int)entries.size();
+	dirty_entries.push_back((int)entries.size());
+	entries.push_back(entry);
+	refreshBounds(entries.back());
+}
+
+void EmitterManager::removeEmitter(IntParticleEmitter* emitter) {
+	auto it = entry_index.find(emitter);
+	if (it == entry_index.end()) return;
+
+	int index = it->second;
+	entry_index.erase(it);
+	if (entries[index].cell != NO_CELL) unbin(index);
+	if (entries[index].awake) replaceIndex(awake_entries, index, -1);
+	if (entries[index].dirty) replaceIndex(dirty_entries, index, -1);
+
+	//move the last one in its place so the indices stay dense
+	int last = (int)entries.size() - 1;
+	if (index != last) {
+		renumber(last, index);
+		entries[index] = entries[last];
+		entry_index[entries[index].emitter] = index;
+	}
+	entries.pop_back();
+}
+
+void EmitterManager::moveEmitter(IntParticleEmitter* emitter, glm::vec3 position) {
+	emitter->emitter_pos = position;
+	auto it = entry_index.find(emitter);
+	if (it == entry_index.end()) return;
+
+	EmitterEntry& entry = entries[it->second];
+	if (!entry.dirty && cellKey(position) != entry.cell) {
+		entry.dirty = true;
+		dirty_entries.push_back(it->second);
+	}
+}
+
+bool EmitterManager::isAwake(const IntParticleEmitter* emitter) const {
+	auto it = entry_index.find(emitter);
+	//emitters that are not managed are always drawn
+	return it == entry_index.end() || entries[it->second].awake;
+}
+
+long long EmitterManager::cellKey(glm::ivec3 cell) const {
+	//21 bits per axis
+	long long x = (long long)cell.x & 0x1FFFFF;
+	long long y = (long long)cell.y & 0x1FFFFF;
+	long long z = (long long)cell.z & 0x1FFFFF;
+	return (x << 42) | (y << 21) | z;
+}
+
+long long EmitterManager::cellKey(glm::vec3 position) const {
+	return cellKey(glm::ivec3(glm::floor(position / cell_size)));
+}
+
+void EmitterManager::bin(int index) {
+	EmitterEntry& entry = entries[index];
+	glm::vec3 position = entry.emitter->emitter_pos;
+	entry.cell = cellKey(position);
+
+	Cell& cell = grid[entry.cell];
+	if (cell.entries.empty()) {
+		cell.origin = glm::floor(position / cell_size) * cell_size;
+		cell.reach = glm::vec3(0.0f);
+	}
+	cell.entries.push_back(index);
+	cell.reach = glm::max(cell.reach, glm::max(-entry.local_min, entry.local_max));
+	max_reach = std::max(max_reach, glm::length(cell.reach));
+}
+
+void EmitterManager::unbin(int index) {
+	auto it = grid.find(entries[index].cell);
+	replaceIndex(it->second.entries, index, -1);
+	//empty cells are dropped so the grid only holds occupied ones
+	if (it->second.entries.empty()) grid.erase(it);
+	entries[index].cell = NO_CELL;
+}
+
+void EmitterManager::renumber(int from, int to) {
+	const EmitterEntry& entry = entries[from];
+	if (entry.cell != NO_CELL) replaceIndex(grid[entry.cell].entries, from, to);
+	if (entry.awake) replaceIndex(awake_entries, from, to);
+	if (entry.dirty) replaceIndex(dirty_entries, from, to);
+}
+
+void EmitterManager::refreshBounds(EmitterEntry& entry) {
+	IntParticleEmitter* emitter = entry.emitter;
+	glm::vec3 local_min(-entry.radius), local_max(entry.radius);
+	for (int i = 0; i < emitter->number_of_particles; i++) {
+		const particleAttributes& p = emitter->p_attributes[i];
+		if (p.life == 0.0f) continue; //never spawned
+		glm::vec3 local = p.position - emitter->emitter_pos;
+		local_min = glm::min(local_min, local);
+		local_max = glm::max(local_max, local);
+	}
+	entry.local_min = local_min;
+	entry.local_max = local_max;
+}
+
+void EmitterManager::wake(int index, glm::vec3 camera_pos, const Frustum& frustum) {
+	EmitterEntry& entry = entries[index];
+	glm::vec3 world_min = entry.emitter->emitter_pos + entry.local_min;
+	glm::vec3 world_max = entry.emitter->emitter_pos + entry.local_max;
+	glm::vec3 closest = glm::clamp(camera_pos, world_min, world_max);
+	if (glm::length(closest - camera_pos) <= sleep_distance && frustum.intersectsAABB(world_min, world_max)) {
+		entry.awake = true;
+		awake_entries.push_back(index);
+	}
+}
+
+void EmitterManager::updateEmitters(float time, float dt, glm::vec3 camera_pos, const glm::mat4& PV) {
+	//only the emitters that were added or moved change cells
+	for (int index : dirty_entries) {
+		EmitterEntry& entry = entries[index];
+		entry.dirty = false;
+		if (entry.cell == NO_CELL) {
+			entry.last_update = time - dt; //new emitters start from now
+		} else if (cellKey(entry.emitter->emitter_pos) == entry.cell) {
+			continue;
+		} else {
+			unbin(index);
+		}
+		bin(index);
+	}
+	dirty_entries.clear();
+
+	std::vector<int> was_awake;
+	was_awake.swap(awake_entries);
+	for (int index : was_awake) {
+		entries[index].awake = false;
+	}
+
+	//whole cells are skipped first, only emitters in visible cells are tested one by one
+	Frustum frustum(PV);
+	auto visitCell = [&](const Cell& cell) {
+		glm::vec3 cell_min = cell.origin - cell.reach;
+		glm::vec3 cell_max = cell.origin + cell_size + cell.reach;
+		glm::vec3 closest = glm::clamp(camera_pos, cell_min, cell_max);
+		if (glm::length(closest - camera_pos) > sleep_distance) return;
+		if (!frustum.intersectsAABB(cell_min, cell_max)) return;
+		for (int index : cell.entries) {
+			wake(index, camera_pos, frustum);
+		}
+	};
+
+	//look up the cells around the camera, or go through the occupied ones if there are fewer
+	float range = sleep_distance + max_reach;
+	glm::ivec3 low(glm::floor((camera_pos - range) / cell_size));
+	glm::ivec3 high(glm::floor((camera_pos + range) / cell_size));
+	glm::ivec3 span = high - low + 1;
+	if ((double)span.x * span.y * span.z < (double)grid.size()) {
+		for (int x = low.x; x <= high.x; x++) {
+			for (int y = low.y; y <= high.y; y++) {
+				for (int z = low.z; z <= high.z; z++) {
+					auto it = grid.find(cellKey(glm::ivec3(x, y, z)));
+					if (it != grid.end()) visitCell(it->second);
+				}
+			}
+		}
+	} else {
+		for (auto& cell_item : grid) {
+			visitCell(cell_item.second);
+		}
+	}
+
+	for (int index : was_awake) {
+		if (!entries[index].awake) entries[index].behind = true;
+	}
+
+	for (int index : awake_entries) {
+		EmitterEntry& entry = entries[index];
+
+		//Catch up with the time spent asleep using a few coarse steps
+		if (entry.behind) {
+			float remaining = std::min(time - dt - entry.last_update, max_fast_forward);
+			float step_time = time - dt - remaining;
+			while (remaining > 0.0f) {
+				float step = std::min(fast_forward_step, remaining);
+				step_time += step;
+				entry.emitter->updateParticles(step_time, step, camera_pos);
+				remaining -= step;
+			}
+			entry.behind = false;
+		}
+
+		entry.emitter->updateParticles(time, dt, camera_pos);
+		entry.last_update = time;
+		refreshBounds(entry);
+
+		//awake emitters may have been moved directly, and their bounds have grown
+		if (cellKey(entry.emitter->emitter_pos) != entry.cell) {
+			unbin(index);
+			bin(index);
+		} else {
+			Cell& cell = grid[entry.cell];
+			cell.reach = glm::max(cell.reach, glm::max(-entry.local_min, entry.local_max));
+			max_reach = std::max(max_reach, glm::length(cell.reach));
+		}
+	}
+}
@@ -0,0 +1,74 @@
+#ifndef VVR_OGL_LABORATORY_EMITTERMANAGER_H
+#define VVR_OGL_LABORATORY_EMITTERMANAGER_H
+
+#include <vector>
+#include <unordered_map>
+#include "IntParticleEmitter.h"
+
+class Frustum;
+
+//Keeps the bounds of many emitters in a uniform grid and only updates the ones
+//that are inside the view frustum and closer than sleep_distance. The others sleep:
+//they are neither updated nor drawn, and are fast forwarded when they wake up.
+//The per frame cost depends on the cells near the camera and the awake emitters,
+//sleeping emitters are not touched unless they are moved.
+class EmitterManager {
+public:
+	EmitterManager(float cell_size = 64.0f);
+
+	//radius is the minimum extent of the emitter around emitter_pos, it is grown
+	//with the bounds of the particles every time the emitter is updated
+	void addEmitter(IntParticleEmitter* emitter, float radius);
+	void removeEmitter(IntParticleEmitter* emitter);
+
+	//Sets emitter_pos and moves the emitter in the grid. Sleeping emitters must be
+	//moved through it, awake ones are re-binned when they are updated anyway.
+	void moveEmitter(IntParticleEmitter* emitter, glm::vec3 position);
+
+	void updateEmitters(float time, float dt, glm::vec3 camera_pos, const glm::mat4& PV);
+
+	bool isAwake(const IntParticleEmitter* emitter) const;
+	int awakeEmitters() const { return (int)awake_entries.size(); }
+	int totalEmitters() const { return (int)entries.size(); }
+
+	float sleep_distance = 300.0f;
+	float max_fast_forward = 2.0f; //seconds simulated at most when an emitter wakes up
+	float fast_forward_step = 0.1f;
+
+private:
+	struct EmitterEntry {
+		IntParticleEmitter* emitter;
+		glm::vec3 local_min, local_max; //relative to emitter_pos
+		float radius;
+		bool awake;
+		bool dirty; //moved, or added and not binned yet
+		bool behind; //has slept since last_update, it is fast forwarded from there when it wakes up
+		float last_update;
+		long long cell; //key of the cell of emitter_pos
+	};
+
+	struct Cell {
+		std::vector<int> entries;
+		glm::vec3 origin; //minimum corner
+		glm::vec3 reach; //largest extent of the bounds of its emitters around their emitter_pos
+	};
+
+	float cell_size;
+	float max_reach = 0.0f; //length of the largest cell reach, it only grows
+	std::vector<EmitterEntry> entries;
+	std::vector<int> awake_entries;
+	std::vector<int> dirty_entries;
+	std::unordered_map<const IntParticleEmitter*, int> entry_index;
+	std::unordered_map<long long, Cell> grid;
+
+	long long cellKey(glm::vec3 position) const;
+	long long cellKey(glm::ivec3 cell) const;
+	void bin(int index);
+	void unbin(int index);
+	void renumber(int from, int to);
+	void refreshBounds(EmitterEntry& entry);
+	void wake(int index, glm::vec3 camera_pos, const Frustum& frustum);
+};
+
+
+#endif //VVR_OGL_LABORATORY_EMITTERMANAGER_H
@@ -0,0 +1,148 @@
+#ifndef VVR_OGL_LABORATORY_EMITTERPOLICIES_H
+#define VVR_OGL_LABORATORY_EMITTERPOLICIES_H
+
+#include <vector>
+#include <cmath>
+#include "IntParticleEmitter.h"
+
+//Policies for PolicyEmitter. Every emitter is composed of:
+//  Spawn:     void spawn(particleAttributes&, int index, glm::vec3 emitter_pos)
+//             void resize(int number)                 per particle storage, if any
+//             static constexpr int batch                  particles spawned per frame, 0 = all at once
+//  Force:     template<class S> void integrate(particleAttributes&, int index, float dt, glm::vec3 emitter_pos, const S& spawn)
+//  Collision: bool collides(const particleAttributes&) const
+//  Kill:      bool expired(const particleAttributes&, glm::vec3 emitter_pos) const
+//             void updateLife(particleAttributes&, glm::vec3 emitter_pos) const
+//  Orient:    template<class E> void orient(particleAttributes&, glm::vec3 camera_pos, E& emitter) const
+//             after integrate, E is the emitter
+//All the methods are small and non virtual so the update loop is inlined for each combination.
+
+
+//Spawn policies
+
+//Rain drops spawned above the emitter, falling with some wind
+struct FountainSpawn {
+	static constexpr int batch = 50;
+
+	void resize(int /*number*/) {}
+
+	void spawn(particleAttributes& particle, int /*index*/, glm::vec3 emitter_pos) {
+		particle.position = emitter_pos - glm::vec3(RAND * 50, -40, RAND * 23);
+		particle.velocity = glm::vec3(
+			5 - RAND * particle.factorXWind,
+			-particle.speedYDroplet,
+			5 - RAND * particle.factorZWind) * particle.speedDropFall;
+		particle.mass = RAND / 2 - RAND / 4;
+		particle.rot_axis = glm::normalize(glm::vec3(
+			1 - particle.factorXWind * RAND,
+			1 - 2 * RAND,
+			1 - particle.factorZWind * RAND));
+		particle.accel = glm::vec3(0.0f, -9.8f, 0.0f);
+		particle.rot_angle = RAND * 360;
+		particle.life = 4.0f; //mark it alive
+	}
+};
+
+//Particles on circles of random radius around the emitter
+struct OrbitSpawn {
+	static constexpr int batch = 0;
+
+	float radius_min, radius_max;
+	std::vector<float> particle_radius;
+
+	OrbitSpawn(float _radius_min = 5.0f, float _radius_max = 6.0f) : radius_min(_radius_min), radius_max(_radius_max) {}
+
+	void resize(int number) { particle_radius.resize(number, 0.0f); }
+
+	void spawn(particleAttributes& particle, int index, glm::vec3 /*emitter_pos*/) {
+		particle_radius[index] = RAND * (radius_max - radius_min) + radius_min;
+		particle.rot_angle = 360 * RAND;
+		particle.rot_axis = glm::normalize(glm::vec3(1 - 2 * RAND, 1 - 2 * RAND, 1 - 2 * RAND));
+		particle.mass = RAND + 0.5f;
+		particle.life = 1.0f; //mark it alive
+	}
+};
+
+
+//Force models
+
+//Pulls the particles towards the y axis, acceleration = -position on x and z
+struct AxisSpringForce {
+	template <class S>
+	void integrate(particleAttributes& particle, int /*index*/, float dt, glm::vec3 /*emitter_pos*/, const S& /*spawn*/) const {
+		particle.accel = glm::vec3(-particle.position.x, 0.0f, -particle.position.z);
+		particle.position = particle.position + particle.velocity * dt + particle.accel * (dt * dt) * 0.5f;
+		particle.velocity = particle.velocity + particle.accel * dt;
+	}
+};
+
+//Moves the particles on their circle, needs the particle_radius of OrbitSpawn
+struct OrbitMotion {
+	template <class S>
+	void integrate(particleAttributes& particle, int index, float dt, glm::vec3 emitter_pos, const S& spawn) const {
+		float radius = spawn.particle_radius[index];
+		particle.rot_angle += dt;
+		particle.position = emitter_pos + glm::vec3(radius * sin(particle.rot_angle), 0.0f, radius * cos(particle.rot_angle));
+	}
+};
+
+
+//Collision
+
+struct GroundCollision {
+	float ground_height = 0.0f;
+
+	bool collides(const particleAttributes& particle) const { return particle.position.y < ground_height; }
+};
+
+struct NoCollision {
+	bool collides(const particleAttributes& /*particle*/) const { return false; }
+};
+
+
+//Kill rules
+
+//Same rules as FountainEmitter::shouldRespawn
+struct FountainKill {
+	float height_threshold = 1.0f;
+
+	bool expired(const particleAttributes& particle, glm::vec3 emitter_pos) const {
+		return particle.life == 0.0f ||
+			particle.position.y < emitter_pos.y - 500.0f ||
+			particle.position.x < emitter_pos.x - 800.0f ||
+			particle.position.z < emitter_pos.z ||
+			particle.position.y > height_threshold;
+	}
+
+	void updateLife(particleAttributes& particle, glm::vec3 emitter_pos) const {
+		particle.life = (height_threshold - particle.position.y) / (height_threshold - emitter_pos.y);
+	}
+};
+
+struct NeverKill {
+	bool expired(const particleAttributes& /*particle*/, glm::vec3 /*emitter_pos*/) const { return false; }
+
+	void updateLife(particleAttributes& /*particle*/, glm::vec3 /*emitter_pos*/) const {}
+};
+
+
+//Orientation
+
+//Turns the particles towards the camera, as FountainEmitter does
+struct FaceCamera {
+	template <class E>
+	void orient(particleAttributes& particle, glm::vec3 camera_pos, E& emitter) const {
+		glm::vec4 bill_rot = emitter.calculateBillboardRotationMatrix(particle.position, camera_pos);
+		particle.rot_axis = glm::vec3(bill_rot.x, bill_rot.y, bill_rot.z);
+		particle.rot_angle = glm::degrees(bill_rot.w);
+	}
+};
+
+//Keeps the rotation given at spawn
+struct KeepOrientation {
+	template <class E>
+	void orient(particleAttributes& /*particle*/, glm::vec3 /*camera_pos*/, E& /*emitter*/) const {}
+};
+
+
+#endif //VVR_OGL_LABORATORY_EMITTERPOLICIES_H
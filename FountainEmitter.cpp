@@ -1,6 +1,7 @@
 #include "FountainEmitter.h"
 #include <iostream>
 #include <algorithm>
+#include <chrono>
 
 FountainEmitter::FountainEmitter(Drawable *_model, int number) : IntParticleEmitter(_model, number) {}
 //float speedYDroplet = 25.0f;
@@ -27,18 +28,7 @@ void FountainEmitter::updateParticles(float time, float dt, glm::vec3 camera_pos
 	for (int i = 0; i < active_particles; i++) {
 		particleAttributes & particle = p_attributes[i];
 
-		if (particle.position.y < (emitter_pos.y - 500.0) || particle.life == 0.0f || checkForCollision(particle)) {
-			createNewParticle(i);
-		}
-		// TO CHECK
-		if (particle.position.x < (emitter_pos.x - 800.0f) || particle.life == 0.0f || checkForCollision(particle)) {
-			createNewParticle(i);
-		}
-		if (particle.position.z < emitter_pos.z || particle.life == 0.0f || checkForCollision(particle)) {
-			createNewParticle(i);
-		}
-
-		if (particle.position.y > height_threshold)
+		if (shouldRespawn(particle))
 			createNewParticle(i);
 
 		particle.accel = glm::vec3(-particle.position.x, 0.0f, -particle.position.z); //gravity force
@@ -58,6 +48,54 @@ void FountainEmitter::updateParticles(float time, float dt, glm::vec3 camera_pos
 	}
 }
 
+//The closed form needs no time step, so step is ignored
+float FountainEmitter::prewarm(float seconds, float /*step*/, float budget_ms) {
+	auto start = std::chrono::steady_clock::now();
+	auto overBudget = [&]() {
+		std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		return budget_ms > 0.0f && elapsed.count() > budget_ms;
+	};
+
+	//The acceleration is -position on x and z, so both are harmonic oscillators with
+	//period 2pi, while y keeps its spawn velocity:
+	//   x(t) = x0 cos(t) + v0 sin(t),  v(t) = v0 cos(t) - x0 sin(t),  y(t) = y0 + vy t
+	//Each particle is spawned and placed in one go, so the ones left when the budget runs
+	//out have not been touched and ramp up later like without a pre-warm
+	int placed = 0;
+	for (; placed < number_of_particles; placed++) {
+		if ((placed & 1023) == 1023 && overBudget()) break;
+		if (placed >= active_particles)
+			createNewParticle(active_particles++);
+		particleAttributes & particle = p_attributes[placed];
+
+		float lifetime = seconds;
+		if (particle.velocity.y < 0.0f)
+			lifetime = std::min(lifetime, std::max(0.0f, particle.position.y / -particle.velocity.y)); //until it reaches the ground
+		float age = RAND * lifetime;
+		float c = cos(age), s = sin(age);
+
+		glm::vec3 p0 = particle.position, v0 = particle.velocity;
+		particle.position = glm::vec3(p0.x * c + v0.x * s, p0.y + v0.y * age, p0.z * c + v0.z * s);
+		particle.velocity = glm::vec3(v0.x * c - p0.x * s, v0.y, v0.z * c - p0.z * s);
+		particle.life = (height_threshold - particle.position.y) / (height_threshold - emitter_pos.y);
+
+		if (shouldRespawn(particle))
+			createNewParticle(placed);
+	}
+
+	return number_of_particles > 0 ? seconds * placed / number_of_particles : seconds;
+}
+
+bool FountainEmitter::shouldRespawn(particleAttributes& particle)
+{
+	if (particle.life == 0.0f || checkForCollision(particle)) return true;
+	if (particle.position.y < (emitter_pos.y - 500.0)) return true;
+	// TO CHECK
+	if (particle.position.x < (emitter_pos.x - 800.0f)) return true;
+	if (particle.position.z < emitter_pos.z) return true;
+	return particle.position.y > height_threshold;
+}
+
 bool FountainEmitter::checkForCollision(particleAttributes& particle)
 {
 	return particle.position.y < 0.0f;
@@ -16,12 +16,20 @@ public:
 	float height_threshold = 1.0f;
 
 	bool checkForCollision(particleAttributes& particle);
+	bool shouldRespawn(particleAttributes& particle);
 
 	int active_particles = 0; //number of particles that have been instantiated
 	void createNewParticle(int index) override;
 	
 	void updateParticles(float time, float dt, glm::vec3 camera_pos = glm::vec3(0, 0, 0)) override;
 
+	//Spawns all the particles at once and moves each one to a random point of its
+	//trajectory using the closed form of the motion, instead of ramping up 50 per frame.
+	//Unlike the default, step is ignored since nothing is stepped. Particles left when
+	//the budget runs out are ramped up as usual. Returns seconds scaled by the share of
+	//the particles that were placed.
+	float prewarm(float seconds, float step = 1.0f / 30.0f, float budget_ms = 50.0f) override;
+
 	
 };
 
@@ -0,0 +1,199 @@
+#include "GPUDrivenRenderer.h"
+#include <common/shader.h>
+#include <common/framebuffer.h>
+#include <common/frustum.h>
+#include <algorithm>
+#include <vector>
+
+using namespace glm;
+using namespace std;
+
+// std430 layouts of GPUCull.computeshader
+struct MeshRecord {
+    vec4 boundsMin, boundsMax;
+    GLuint indexCount, firstIndex;
+    GLint baseVertex;
+    GLuint padding;
+};
+
+struct DrawElementsIndirectCommand {
+    GLuint count, instanceCount, firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+bool GPUDrivenRenderer::isSupported() {
+    return GLEW_VERSION_4_3 ||
+           (GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object && GLEW_ARB_multi_draw_indirect);
+}
+
+GPUDrivenRenderer::GPUDrivenRenderer(const ogl::Model& model, int width, int height)
+        : width(width), height(height), viewportWidth(width), viewportHeight(height),
+          pyramidWidth(width), pyramidHeight(height), pyramidLevels(1), hasPyramid(false) {
+    compact = GLEW_ARB_indirect_parameters != 0;
+
+    // the full level of each mesh in the merged buffers of the model
+    vector<MeshRecord> records;
+    for (const auto& mesh : model.getMeshes()) {
+        MeshRecord record;
+        record.boundsMin = vec4(mesh.boundsMin, 1.0f);
+        record.boundsMax = vec4(mesh.boundsMax, 1.0f);
+        record.indexCount = mesh.lods[0].indexCount;
+        record.firstIndex = mesh.lods[0].firstIndex;
+        record.baseVertex = mesh.baseVertex;
+        record.padding = 0;
+        records.push_back(record);
+    }
+    meshes = (int) records.size();
+    VAO = model.VAO;
+    quantization = model.quantization;
+
+    glGenBuffers(1, &meshBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, records.size() * sizeof(MeshRecord), records.data(), GL_STATIC_DRAW);
+    glGenBuffers(1, &commandBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, records.size() * sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_DRAW);
+    glGenBuffers(1, &countBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // level 0 is a copy of the scene depth, each level keeps the farthest depth of 2x2 texels
+    depthTexture = createAttachmentTexture(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL,
+                                           GL_UNSIGNED_INT_24_8, width, height);
+    glGenFramebuffers(1, &depthFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, depthFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    glDrawBuffer(GL_NONE);
+    checkFramebufferStatus("depth pyramid");
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    levels = 1;
+    while ((std::max(width, height) >> levels) > 0) levels++;
+    glGenTextures(1, &pyramidTexture);
+    glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+    glTexStorage2D(GL_TEXTURE_2D, levels, GL_R32F, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    cullProgram = loadComputeShader("GPUCull.computeshader");
+    cullPVLocation = glGetUniformLocation(cullProgram, "PV");
+    cullPyramidPVLocation = glGetUniformLocation(cullProgram, "pyramidPV");
+    cullPlanesLocation = glGetUniformLocation(cullProgram, "planes");
+    cullMeshCountLocation = glGetUniformLocation(cullProgram, "meshCount");
+    cullOcclusionLocation = glGetUniformLocation(cullProgram, "useOcclusion");
+    cullCompactLocation = glGetUniformLocation(cullProgram, "compact");
+    cullPyramidSizeLocation = glGetUniformLocation(cullProgram, "pyramidSize");
+    cullLevelsLocation = glGetUniformLocation(cullProgram, "pyramidLevels");
+    cullPyramidSamplerLocation = glGetUniformLocation(cullProgram, "depthPyramid");
+
+    pyramidProgram = loadComputeShader("HiZBuild.computeshader");
+    pyramidCopyDepthLocation = glGetUniformLocation(pyramidProgram, "copyDepth");
+    pyramidSourceSizeLocation = glGetUniformLocation(pyramidProgram, "sourceSize");
+    pyramidDestinationSizeLocation = glGetUniformLocation(pyramidProgram, "destinationSize");
+}
+
+GPUDrivenRenderer::~GPUDrivenRenderer() {
+    glDeleteBuffers(1, &meshBuffer);
+    glDeleteBuffers(1, &commandBuffer);
+    glDeleteBuffers(1, &countBuffer);
+    glDeleteFramebuffers(1, &depthFramebuffer);
+    glDeleteTextures(1, &depthTexture);
+    glDeleteTextures(1, &pyramidTexture);
+    glDeleteProgram(cullProgram);
+    glDeleteProgram(pyramidProgram);
+}
+
+void GPUDrivenRenderer::draw(const mat4& PV) {
+    if (meshes == 0) return;
+
+    GLint drawProgram;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &drawProgram);
+
+    GLuint zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    Frustum frustum(PV);
+    glUseProgram(cullProgram);
+    glUniformMatrix4fv(cullPVLocation, 1, GL_FALSE, &PV[0][0]);
+    glUniformMatrix4fv(cullPyramidPVLocation, 1, GL_FALSE, &pyramidPV[0][0]);
+    glUniform4fv(cullPlanesLocation, 6, &frustum.planes[0][0]);
+    glUniform1ui(cullMeshCountLocation, (GLuint) meshes);
+    glUniform1i(cullOcclusionLocation, hasPyramid);
+    glUniform1i(cullCompactLocation, compact);
+    glUniform2i(cullPyramidSizeLocation, pyramidWidth, pyramidHeight);
+    glUniform1i(cullLevelsLocation, pyramidLevels);
+    // unit 0 keeps the texture of the draw program
+    glUniform1i(cullPyramidSamplerLocation, 1);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+    glActiveTexture(GL_TEXTURE0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, meshBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, countBuffer);
+    glDispatchCompute((meshes + 63) / 64, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+    glUseProgram(drawProgram);
+    DequantizeUniforms::locate((GLuint) drawProgram).upload(quantization);
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    if (compact) {
+        glBindBuffer(GL_PARAMETER_BUFFER_ARB, countBuffer);
+        glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, 0, 0, meshes, 0);
+        glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+    } else {
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, meshes, 0);
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void GPUDrivenRenderer::setViewport(int newWidth, int newHeight) {
+    viewportWidth = std::min(newWidth, width);
+    viewportHeight = std::min(newHeight, height);
+}
+
+void GPUDrivenRenderer::buildDepthPyramid(const mat4& PV, GLuint sceneFramebuffer) {
+    copyDepth(sceneFramebuffer, depthFramebuffer, viewportWidth, viewportHeight);
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+
+    // only the levels covering the viewport are built, the texture keeps the full size
+    pyramidWidth = viewportWidth;
+    pyramidHeight = viewportHeight;
+    pyramidLevels = 1;
+    while ((std::max(pyramidWidth, pyramidHeight) >> pyramidLevels) > 0) pyramidLevels++;
+
+    glUseProgram(pyramidProgram);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    int sourceWidth = pyramidWidth, sourceHeight = pyramidHeight;
+    for (int level = 0; level < pyramidLevels; level++) {
+        int destinationWidth = level == 0 ? pyramidWidth : std::max(1, sourceWidth / 2);
+        int destinationHeight = level == 0 ? pyramidHeight : std::max(1, sourceHeight / 2);
+
+        // level 0 samples the depth copy, the others load the previous level as an image,
+        // the pyramid is never bound to a sampler while one of its levels is written
+        glUniform1i(pyramidCopyDepthLocation, level == 0);
+        glUniform2i(pyramidSourceSizeLocation, sourceWidth, sourceHeight);
+        glUniform2i(pyramidDestinationSizeLocation, destinationWidth, destinationHeight);
+        glBindImageTexture(0, pyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        if (level > 0) {
+            glBindImageTexture(1, pyramidTexture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        }
+        glDispatchCompute((destinationWidth + 7) / 8, (destinationHeight + 7) / 8, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+        sourceWidth = destinationWidth;
+        sourceHeight = destinationHeight;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    pyramidPV = PV;
+    hasPyramid = true;
+}
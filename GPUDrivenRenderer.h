@@ -0,0 +1,65 @@
+#ifndef GPU_DRIVEN_RENDERER_H
+#define GPU_DRIVEN_RENDERER_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <model.h>
+
+/**
+* GPU driven drawing of an ogl::Model.
+*
+* The meshes are drawn from the merged vertex and index buffer of the model,
+* which must outlive the renderer. Their bounds and draw parameters live in
+* a shader storage buffer. Every frame a compute
+* pass (GPUCull.computeshader) tests each mesh against the frustum and
+* against a hierarchical depth buffer built from the previous frame, and
+* appends the survivors to a glMultiDrawElementsIndirect buffer. The whole
+* model is then drawn with one call, the CPU does no per mesh work.
+*
+* The depth pyramid is built from the frame that was just drawn and tested
+* with that frame's PV, so geometry that becomes visible by camera motion
+* can show up one frame late. All meshes use the program and texture that
+* are bound when draw() is called, there is no per mesh material.
+*
+* Needs OpenGL 4.3 (compute shaders, storage buffers, multi draw indirect).
+* With ARB_indirect_parameters the command list is compacted and drawn with
+* the count from the GPU, otherwise culled commands get 0 instances.
+*/
+class GPUDrivenRenderer {
+public:
+    static bool isSupported();
+
+    GPUDrivenRenderer(const ogl::Model& model, int width, int height);
+    ~GPUDrivenRenderer();
+
+    /* Cull and draw with the bound program and unit 0 texture, PV is model space to clip.
+     * Changes the bound VAO and uses texture unit 1 */
+    void draw(const glm::mat4& PV);
+
+    /* Call after the opaque pass, the next draw() is occlusion tested against it */
+    void buildDepthPyramid(const glm::mat4& PV, GLuint sceneFramebuffer = 0);
+
+    int meshCount() const { return meshes; }
+
+    /* Build the pyramid from the bottom-left width x height of the scene (dynamic resolution) */
+    void setViewport(int width, int height);
+
+private:
+    int width, height, levels, meshes;
+    int viewportWidth, viewportHeight;
+    // size and level count of the last pyramid, the viewport may have changed since
+    int pyramidWidth, pyramidHeight, pyramidLevels;
+    bool compact, hasPyramid;
+    glm::mat4 pyramidPV;
+    GLuint VAO; // of the model
+    VertexQuantization quantization;
+    GLuint meshBuffer, commandBuffer, countBuffer;
+    GLuint depthFramebuffer, depthTexture, pyramidTexture;
+    GLuint cullProgram, pyramidProgram;
+    GLint cullPVLocation, cullPyramidPVLocation, cullPlanesLocation, cullMeshCountLocation,
+          cullOcclusionLocation, cullCompactLocation, cullPyramidSizeLocation, cullLevelsLocation,
+          cullPyramidSamplerLocation;
+    GLint pyramidCopyDepthLocation, pyramidSourceSizeLocation, pyramidDestinationSizeLocation;
+};
+
+#endif
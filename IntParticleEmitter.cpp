@@ -1,6 +1,8 @@
 #include "IntParticleEmitter.h"
 #include "iostream"
 #include <algorithm>
+#include <chrono>
+#include <common/profiler.h>
 
 
 #ifdef USE_PARALLEL_TRANSFORM
@@ -24,8 +26,30 @@ IntParticleEmitter::IntParticleEmitter(Drawable* _model, int number) {
 
 void IntParticleEmitter::renderParticles(int time) {
     if (number_of_particles == 0) return;
-    bindAndUpdateBuffers();
-    glDrawElementsInstanced(GL_TRIANGLES, 3 * model->indices.size(), GL_UNSIGNED_INT, 0, number_of_particles);
+    updateBuffers();
+    glBindVertexArray(emitterVAO);
+    glDrawElementsInstanced(GL_TRIANGLES, indexCount(), GL_UNSIGNED_INT, 0, number_of_particles);
+}
+
+const VertexQuantization& IntParticleEmitter::quantization() const {
+    return model->quantization;
+}
+
+GLsizei IntParticleEmitter::indexCount() const {
+    return model->indexCount;
+}
+
+float IntParticleEmitter::prewarm(float seconds, float step, float budget_ms) {
+    auto start = std::chrono::steady_clock::now();
+    float simulated = 0.0f;
+    while (simulated < seconds) {
+        simulated += step;
+        updateParticles(simulated, step, glm::vec3(0, 0, 0));
+
+        std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        if (budget_ms > 0.0f && elapsed.count() > budget_ms) break;
+    }
+    return simulated;
 }
 
 glm::vec4 IntParticleEmitter::calculateBillboardRotationMatrix(glm::vec3 particle_pos, glm::vec3 camera_pos)
@@ -36,8 +60,10 @@ glm::vec4 IntParticleEmitter::calculateBillboardRotationMatrix(glm::vec3 particl
     return glm::vec4(0, 0, 0, 0);
 }
 
-void IntParticleEmitter::bindAndUpdateBuffers()
+void IntParticleEmitter::updateBuffers()
 {
+    PROFILE_CPU_SCOPE("Buffer packing");
+
     if (use_sorting) {
         std::sort(p_attributes.begin(), p_attributes.end());
         std::reverse(p_attributes.begin(), p_attributes.end());
@@ -88,9 +114,6 @@ void IntParticleEmitter::bindAndUpdateBuffers()
     }
 #endif // USE_PARALLEL_TRANSFORM
 
-    //Bind the VAO
-    glBindVertexArray(emitterVAO);
-
     //Send transformation data to the GPU
     glBindBuffer(GL_ARRAY_BUFFER, transformations_buffer);
     glBufferData(GL_ARRAY_BUFFER, number_of_particles * sizeof(glm::mat4), NULL, GL_STREAM_DRAW); // Buffer orphaning and reallocating to avoid synchronization, see https://www.khronos.org/opengl/wiki/Buffer_Object_Streaming
@@ -124,22 +147,7 @@ void IntParticleEmitter::configureVAO()
 
     //We are using the model's buffer but since they are already in the GPU from the Drawable's constructor we just need to configure 
     //our own VAO by using glVertexAttribPointer and glEnableVertexAttribArray but without sending any data with glBufferData.
-    glBindBuffer(GL_ARRAY_BUFFER, model->verticesVBO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(0);
-
-    if (model->indexedNormals.size() != 0) {
-        glBindBuffer(GL_ARRAY_BUFFER, model->normalsVBO);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray(1);
-    }
-
-
-    if (model->indexedUVS.size() != 0) {
-        glBindBuffer(GL_ARRAY_BUFFER, model->uvsVBO);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray(2);
-    }
+    model->bindVertexAttributes();
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model->elementVBO);
 
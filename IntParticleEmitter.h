@@ -57,9 +57,21 @@ public:
 	void changeParticleNumber(int new_number);
 
 	void renderParticles(int time = 0);
+	//Packs and uploads the particle transformations, renderParticles calls it before drawing.
+	//Call it directly to draw the emitter's VAO yourself (e.g. from a RenderQueue)
+	void updateBuffers();
+	GLsizei indexCount() const;
+	//Dequantization of the particle mesh, see common/quantize.h
+	const VertexQuantization& quantization() const;
 	virtual void updateParticles(float time, float dt, glm::vec3 camera_pos) = 0;
 	virtual void createNewParticle(int index) = 0;
 
+	//Brings the emitter close to its steady state before the first frame, e.g. at load time.
+	//The default implementation simulates `seconds` in fixed steps of `step` and gives up
+	//after budget_ms milliseconds, or never if budget_ms <= 0 (the result then doesn't depend
+	//on the machine, e.g. for replays). Returns the simulated time.
+	virtual float prewarm(float seconds, float step = 1.0f / 30.0f, float budget_ms = 50.0f);
+
 	glm::vec4 calculateBillboardRotationMatrix(glm::vec3 particle_pos, glm::vec3 camera_pos);
 
 private:
@@ -71,7 +83,6 @@ private:
 
 	Drawable* model;
 	void configureVAO();
-	void bindAndUpdateBuffers();
 	GLuint transformations_buffer;
 	GLuint rotations_buffer;
 	GLuint scales_buffer;
@@ -0,0 +1,142 @@
+#include "LowResParticlePass.h"
+#include <common/shader.h>
+#include <common/framebuffer.h>
+
+LowResParticlePass::LowResParticlePass(int width, int height)
+        : width(width), height(height), factor(2), targetFactor(2),
+          viewportWidth(width), viewportHeight(height),
+          lowFramebuffer(0), lowColorTexture(0), lowDepthTexture(0) {
+    // full resolution copy of the opaque depth, read by both passes
+    sceneDepthTexture = createAttachmentTexture(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL,
+                                                GL_UNSIGNED_INT_24_8, width, height);
+    glGenFramebuffers(1, &sceneDepthFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneDepthFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, sceneDepthTexture, 0);
+    glDrawBuffer(GL_NONE);
+    checkFramebufferStatus("scene depth");
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    createLowResTargets();
+
+    downsampleProgram = loadShaders(
+        "FullscreenTriangle.vertexshader",
+        "DepthDownsample.fragmentshader");
+    downsampleDepthLocation = glGetUniformLocation(downsampleProgram, "depthTexture");
+    downsampleFactorLocation = glGetUniformLocation(downsampleProgram, "factor");
+    downsampleLastTexelLocation = glGetUniformLocation(downsampleProgram, "lastTexel");
+
+    compositeProgram = loadShaders(
+        "FullscreenTriangle.vertexshader",
+        "LowResComposite.fragmentshader");
+    particleColorLocation = glGetUniformLocation(compositeProgram, "particleColor");
+    particleDepthLocation = glGetUniformLocation(compositeProgram, "particleDepth");
+    sceneDepthLocation = glGetUniformLocation(compositeProgram, "sceneDepth");
+    compositeFactorLocation = glGetUniformLocation(compositeProgram, "factor");
+    nearFarLocation = glGetUniformLocation(compositeProgram, "nearFar");
+    compositeLastTexelLocation = glGetUniformLocation(compositeProgram, "lastTexel");
+}
+
+LowResParticlePass::~LowResParticlePass() {
+    deleteLowResTargets();
+    glDeleteFramebuffers(1, &sceneDepthFramebuffer);
+    glDeleteTextures(1, &sceneDepthTexture);
+    glDeleteProgram(downsampleProgram);
+    glDeleteProgram(compositeProgram);
+}
+
+void LowResParticlePass::setDownsampleFactor(int newFactor) {
+    if (newFactor < 1) newFactor = 1;
+    targetFactor = newFactor;
+}
+
+void LowResParticlePass::setViewport(int newWidth, int newHeight) {
+    viewportWidth = newWidth < width ? newWidth : width;
+    viewportHeight = newHeight < height ? newHeight : height;
+}
+
+void LowResParticlePass::createLowResTargets() {
+    lowWidth = (width + factor - 1) / factor;
+    lowHeight = (height + factor - 1) / factor;
+
+    // alpha holds the transmittance of the particles in front of the scene
+    lowColorTexture = createAttachmentTexture(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT,
+                                              lowWidth, lowHeight, GL_LINEAR);
+    lowDepthTexture = createAttachmentTexture(GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT,
+                                              GL_FLOAT, lowWidth, lowHeight);
+
+    glGenFramebuffers(1, &lowFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, lowFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, lowColorTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, lowDepthTexture, 0);
+    checkFramebufferStatus("low resolution particles");
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void LowResParticlePass::deleteLowResTargets() {
+    glDeleteFramebuffers(1, &lowFramebuffer);
+    glDeleteTextures(1, &lowColorTexture);
+    glDeleteTextures(1, &lowDepthTexture);
+}
+
+void LowResParticlePass::begin(GLuint sceneFramebuffer) {
+    if (targetFactor != factor) {
+        deleteLowResTargets();
+        factor = targetFactor;
+        createLowResTargets();
+    }
+
+    copyDepth(sceneFramebuffer, sceneDepthFramebuffer, viewportWidth, viewportHeight);
+
+    // downsample the depth, only the depth buffer is written
+    glBindFramebuffer(GL_FRAMEBUFFER, lowFramebuffer);
+    glViewport(0, 0, lowViewportWidth(), lowViewportHeight());
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthFunc(GL_ALWAYS);
+    glUseProgram(downsampleProgram);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, sceneDepthTexture);
+    glUniform1i(downsampleDepthLocation, 0);
+    glUniform1i(downsampleFactorLocation, factor);
+    glUniform2i(downsampleLastTexelLocation, viewportWidth - 1, viewportHeight - 1);
+    drawFullscreenTriangle();
+    glDepthFunc(GL_LESS);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+    // start with no particles: black and fully transmissive
+    const GLfloat clearColor[] = {0.0f, 0.0f, 0.0f, 1.0f};
+    glClearBufferfv(GL_COLOR, 0, clearColor);
+
+    // colour is blended as usual, alpha keeps the product of (1 - alpha)
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+void LowResParticlePass::composite(float nearPlane, float farPlane, GLuint sceneFramebuffer) {
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+    glViewport(0, 0, viewportWidth, viewportHeight);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_DEPTH_TEST);
+    // scene * transmittance + particles
+    glBlendFunc(GL_ONE, GL_SRC_ALPHA);
+
+    glUseProgram(compositeProgram);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, lowColorTexture);
+    glUniform1i(particleColorLocation, 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, lowDepthTexture);
+    glUniform1i(particleDepthLocation, 1);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, sceneDepthTexture);
+    glUniform1i(sceneDepthLocation, 2);
+    glUniform1i(compositeFactorLocation, factor);
+    glUniform2f(nearFarLocation, nearPlane, farPlane);
+    glUniform2i(compositeLastTexelLocation, lowViewportWidth() - 1, lowViewportHeight() - 1);
+    drawFullscreenTriangle();
+
+    // back to the state set in initialize()
+    glActiveTexture(GL_TEXTURE0);
+    glEnable(GL_DEPTH_TEST);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
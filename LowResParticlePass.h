@@ -0,0 +1,55 @@
+#ifndef LOW_RES_PARTICLE_PASS_H
+#define LOW_RES_PARTICLE_PASS_H
+
+#include <GL/glew.h>
+
+/**
+* Off-screen particle rendering at a fraction of the screen resolution.
+*
+* begin() downsamples the opaque scene depth (farthest depth of each block)
+* into a low resolution depth buffer and binds a low resolution target.
+* Particles are then drawn with the usual particle program and blended into
+* it. composite() upsamples the result with a bilateral filter that rejects
+* low resolution samples from a different depth than the full resolution
+* pixel, and blends it over the scene.
+*
+* GPU Gems 3, chapter 23: High-Speed, Off-Screen Particles.
+*/
+class LowResParticlePass {
+public:
+    LowResParticlePass(int width, int height);
+    ~LowResParticlePass();
+
+    /* 1 = full, 2 = half, 4 = quarter resolution. Targets are recreated on the next begin() */
+    void setDownsampleFactor(int factor);
+    int getDownsampleFactor() const { return factor; }
+
+    /* Render into the bottom-left width x height of the scene target (dynamic resolution) */
+    void setViewport(int width, int height);
+
+    /* Call after the opaque pass */
+    void begin(GLuint sceneFramebuffer = 0);
+
+    /* nearPlane and farPlane are used to compare linear depths while upsampling */
+    void composite(float nearPlane, float farPlane, GLuint sceneFramebuffer = 0);
+
+private:
+    int width, height, factor, targetFactor;
+    int viewportWidth, viewportHeight;
+    int lowWidth, lowHeight;
+    GLuint sceneDepthFramebuffer, sceneDepthTexture;
+    GLuint lowFramebuffer, lowColorTexture, lowDepthTexture;
+    GLuint downsampleProgram, downsampleDepthLocation, downsampleFactorLocation,
+           downsampleLastTexelLocation;
+    GLuint compositeProgram, particleColorLocation, particleDepthLocation,
+           sceneDepthLocation, compositeFactorLocation, nearFarLocation,
+           compositeLastTexelLocation;
+
+    int lowViewportWidth() const { return (viewportWidth + factor - 1) / factor; }
+    int lowViewportHeight() const { return (viewportHeight + factor - 1) / factor; }
+
+    void createLowResTargets();
+    void deleteLowResTargets();
+};
+
+#endif
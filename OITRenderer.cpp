@@ -0,0 +1,93 @@
+#include "OITRenderer.h"
+#include <common/shader.h>
+#include <common/framebuffer.h>
+
+OITRenderer::OITRenderer(int width, int height)
+        : width(width), height(height), viewportWidth(width), viewportHeight(height) {
+    accumTexture = createAttachmentTexture(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, width, height);
+    revealTexture = createAttachmentTexture(GL_R8, GL_RED, GL_UNSIGNED_BYTE, width, height);
+    // same format as the default framebuffer so the opaque depth can be blitted
+    depthTexture = createAttachmentTexture(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL,
+                                           GL_UNSIGNED_INT_24_8, width, height);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, revealTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    GLenum drawBuffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, drawBuffers);
+    checkFramebufferStatus("OIT");
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    compositeProgram = loadShaders(
+        "FullscreenTriangle.vertexshader",
+        "OITComposite.fragmentshader");
+    accumSamplerLocation = glGetUniformLocation(compositeProgram, "accumTexture");
+    revealSamplerLocation = glGetUniformLocation(compositeProgram, "revealTexture");
+}
+
+OITRenderer::~OITRenderer() {
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteTextures(1, &accumTexture);
+    glDeleteTextures(1, &revealTexture);
+    glDeleteTextures(1, &depthTexture);
+    glDeleteProgram(compositeProgram);
+}
+
+bool OITRenderer::isSupported() const {
+    return GLEW_VERSION_4_0 || GLEW_ARB_draw_buffers_blend;
+}
+
+void OITRenderer::setBlendFunc(GLuint buffer, GLenum src, GLenum dst) {
+    if (GLEW_VERSION_4_0) {
+        glBlendFunci(buffer, src, dst);
+    } else {
+        glBlendFunciARB(buffer, src, dst);
+    }
+}
+
+void OITRenderer::setViewport(int newWidth, int newHeight) {
+    viewportWidth = newWidth < width ? newWidth : width;
+    viewportHeight = newHeight < height ? newHeight : height;
+}
+
+void OITRenderer::beginAccumulation(GLuint sceneFramebuffer) {
+    // transparent fragments are still hidden by opaque geometry
+    copyDepth(sceneFramebuffer, framebuffer, viewportWidth, viewportHeight);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, viewportWidth, viewportHeight);
+    const GLfloat zero[] = {0.0f, 0.0f, 0.0f, 0.0f};
+    const GLfloat one[] = {1.0f, 1.0f, 1.0f, 1.0f};
+    glClearBufferfv(GL_COLOR, 0, zero);
+    glClearBufferfv(GL_COLOR, 1, one);
+
+    // test against the opaque depth but never write it, the order does not matter
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    setBlendFunc(0, GL_ONE, GL_ONE);
+    setBlendFunc(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+}
+
+void OITRenderer::composite(GLuint sceneFramebuffer) {
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+    glViewport(0, 0, viewportWidth, viewportHeight);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_DEPTH_TEST);
+    glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+
+    glUseProgram(compositeProgram);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, accumTexture);
+    glUniform1i(accumSamplerLocation, 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, revealTexture);
+    glUniform1i(revealSamplerLocation, 1);
+    drawFullscreenTriangle();
+
+    // back to the state set in initialize()
+    glActiveTexture(GL_TEXTURE0);
+    glEnable(GL_DEPTH_TEST);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
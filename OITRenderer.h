@@ -0,0 +1,42 @@
+#ifndef OIT_RENDERER_H
+#define OIT_RENDERER_H
+
+#include <GL/glew.h>
+
+/**
+* Weighted blended order-independent transparency.
+*
+* Transparent geometry is drawn unsorted into an accumulation (RGBA16F) and a
+* revealage (R8) target, depth tested against a copy of the opaque depth
+* buffer. composite() blends the result over the scene. Draw with a program
+* that writes the outputs of ParticleShaderOIT.fragmentshader.
+*
+* http://jcgt.org/published/0002/02/09/
+*/
+class OITRenderer {
+public:
+    OITRenderer(int width, int height);
+    ~OITRenderer();
+
+    /* Per draw buffer blending is needed (GL 4.0 or ARB_draw_buffers_blend) */
+    bool isSupported() const;
+
+    /* Render into the bottom-left width x height of the scene target (dynamic resolution) */
+    void setViewport(int width, int height);
+
+    /* Call after the opaque pass. Binds and clears the OIT targets */
+    void beginAccumulation(GLuint sceneFramebuffer = 0);
+
+    /* Restores the blending state and blends the transparent layer over the scene */
+    void composite(GLuint sceneFramebuffer = 0);
+
+private:
+    int width, height;
+    int viewportWidth, viewportHeight;
+    GLuint framebuffer, accumTexture, revealTexture, depthTexture;
+    GLuint compositeProgram, accumSamplerLocation, revealSamplerLocation;
+
+    void setBlendFunc(GLuint buffer, GLenum src, GLenum dst);
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef VVR_OGL_LABORATORY_POLICYEMITTER_H
+#define VVR_OGL_LABORATORY_POLICYEMITTER_H
+
+#include <algorithm>
+#include "IntParticleEmitter.h"
+#include "EmitterPolicies.h"
+
+//An emitter composed at compile time from a spawn shape, a force model, a collision
+//test, a kill rule and an orientation (see EmitterPolicies.h). Only updateParticles is
+//virtual, the per particle calls are resolved statically and inlined into one loop.
+template <class Spawn, class Force, class Collision, class Kill, class Orient = KeepOrientation>
+class PolicyEmitter : public IntParticleEmitter {
+public:
+	Spawn spawn;
+	Force force;
+	Collision collision;
+	Kill kill;
+	Orient orientation;
+
+	int active_particles = 0; //number of particles that have been instantiated
+
+	PolicyEmitter(Drawable* _model, int number, Spawn _spawn = Spawn(), Force _force = Force(),
+		Collision _collision = Collision(), Kill _kill = Kill())
+		: IntParticleEmitter(_model, number), spawn(_spawn), force(_force), collision(_collision), kill(_kill) {
+		spawn.resize(number_of_particles);
+		if (Spawn::batch == 0) spawnNewParticles(number_of_particles);
+	}
+
+	void updateParticles(float /*time*/, float dt, glm::vec3 camera_pos = glm::vec3(0, 0, 0)) override {
+		//the particle number may have been changed with changeParticleNumber
+		spawn.resize(number_of_particles);
+		active_particles = std::min(active_particles, number_of_particles);
+		spawnNewParticles(Spawn::batch == 0 ? number_of_particles : Spawn::batch);
+
+		const glm::vec3 origin = emitter_pos;
+		particleAttributes* particles = p_attributes.data();
+		for (int i = 0; i < active_particles; i++) {
+			particleAttributes& particle = particles[i];
+			if (collision.collides(particle) || kill.expired(particle, origin))
+				spawn.spawn(particle, i, origin);
+
+			force.integrate(particle, i, dt, origin, spawn);
+			orientation.orient(particle, camera_pos, *this);
+			kill.updateLife(particle, origin);
+		}
+	}
+
+	void createNewParticle(int index) final {
+		spawn.spawn(p_attributes[index], index, emitter_pos);
+	}
+
+private:
+	void spawnNewParticles(int batch) {
+		int limit = std::min(number_of_particles - active_particles, batch);
+		for (int i = 0; i < limit; i++) {
+			spawn.spawn(p_attributes[active_particles], active_particles, emitter_pos);
+			active_particles++;
+		}
+	}
+};
+
+//The two emitters of the scene expressed as policy sets
+typedef PolicyEmitter<FountainSpawn, AxisSpringForce, GroundCollision, FountainKill, FaceCamera> PolicyFountainEmitter;
+typedef PolicyEmitter<OrbitSpawn, OrbitMotion, NoCollision, NeverKill> PolicyOrbitEmitter;
+
+
+#endif //VVR_OGL_LABORATORY_POLICYEMITTER_H
@@ -0,0 +1,96 @@
+#include "RenderQueue.h"
+#include <algorithm>
+
+uint64_t RenderQueue::makeKey(Layer layer, GLuint program, GLuint texture, GLuint vao, float depth) {
+    uint64_t quantizedDepth = (uint64_t) (std::min(std::max(depth, 0.0f), 1.0f) * 0xFFFFFF);
+    uint64_t state = ((uint64_t) (program & 0x3FF) << 24) |
+                     ((uint64_t) (texture & 0xFFF) << 12) |
+                     (uint64_t) (vao & 0xFFF);
+    uint64_t key = (uint64_t) layer << 62;
+    if (layer == TRANSPARENT_LAYER) {
+        // blending needs back to front, state changes come second
+        key |= ((0xFFFFFF - quantizedDepth) << 34) | state;
+    } else {
+        key |= (state << 24) | quantizedDepth;
+    }
+    return key;
+}
+
+void RenderQueue::submit(const DrawItem& item) {
+    items.push_back(item);
+}
+
+void RenderQueue::clear() {
+    items.clear();
+    draws = 0;
+}
+
+void RenderQueue::sort() {
+    size_t n = items.size();
+    keys.resize(n);
+    keysScratch.resize(n);
+    order.resize(n);
+    orderScratch.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = items[i].key;
+        order[i] = (uint32_t) i;
+    }
+
+    // LSD radix sort, 8 passes of 8 bits. Stable, so equal keys keep the submit order.
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t histogram[256] = {0};
+        for (size_t i = 0; i < n; i++) {
+            histogram[(keys[i] >> shift) & 0xFF]++;
+        }
+        // all keys share this byte, nothing to do
+        if (n == 0 || histogram[(keys[0] >> shift) & 0xFF] == n) continue;
+
+        size_t offset = 0;
+        for (int b = 0; b < 256; b++) {
+            size_t count = histogram[b];
+            histogram[b] = offset;
+            offset += count;
+        }
+        for (size_t i = 0; i < n; i++) {
+            size_t destination = histogram[(keys[i] >> shift) & 0xFF]++;
+            keysScratch[destination] = keys[i];
+            orderScratch[destination] = order[i];
+        }
+        keys.swap(keysScratch);
+        order.swap(orderScratch);
+    }
+}
+
+void RenderQueue::execute(GLStateCache& state, Layer layer) {
+    for (size_t i = 0; i < order.size(); i++) {
+        if ((keys[i] >> 62) != (uint64_t) layer) continue;
+
+        const DrawItem& item = items[order[i]];
+        state.useProgram(item.program);
+        state.bindVertexArray(item.vao);
+        if (item.texture != 0) {
+            state.bindTexture(0, GL_TEXTURE_2D, item.texture);
+        }
+        if (item.samplerLocation >= 0) {
+            state.uniform1i(item.samplerLocation, 0);
+        }
+        if (item.setup) {
+            item.setup(item.user);
+        }
+
+        if (item.indexType == 0) {
+            if (item.instances > 0)
+                glDrawArraysInstanced(item.mode, item.first, item.count, item.instances);
+            else
+                glDrawArrays(item.mode, item.first, item.count);
+        } else {
+            size_t indexSize = item.indexType == GL_UNSIGNED_INT ? 4 : item.indexType == GL_UNSIGNED_SHORT ? 2 : 1;
+            const void* offset = (const void*) (item.first * indexSize);
+            if (item.instances > 0)
+                glDrawElementsInstanced(item.mode, item.count, item.indexType, offset, item.instances);
+            else
+                glDrawElements(item.mode, item.count, item.indexType, offset);
+        }
+        draws++;
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <GL/glew.h>
+#include <vector>
+#include <cstdint>
+#include <common/glstate.h>
+
+/**
+* A draw call and the state it needs. setup is called right before the draw,
+* after the program, VAO and texture are bound, to upload per object data.
+*/
+struct DrawItem {
+    uint64_t key;
+    GLuint program;
+    GLuint vao;
+    GLuint texture;          // bound to unit 0, 0 for none
+    GLint samplerLocation;   // set to 0 if >= 0
+    GLenum mode;
+    GLsizei count;
+    GLsizei first;           // first index or vertex
+    GLenum indexType;        // 0 for glDrawArrays
+    GLsizei instances;       // 0 for a non instanced draw
+    void (*setup)(void* user);
+    void* user;
+};
+
+/**
+* Passes submit DrawItems with a 64 bit sort key. The queue radix sorts them
+* and executes them through a GLStateCache, so the driver calls follow the
+* number of state changes and not the number of objects.
+*
+* Key layout, most significant bits first:
+*   opaque:      layer(2) program(10) texture(12) vao(12) depth(24, front to back)
+*   transparent: layer(2) depth(24, back to front) program(10) texture(12) vao(12)
+*/
+class RenderQueue {
+public:
+    enum Layer { OPAQUE_LAYER = 0, TRANSPARENT_LAYER = 1 };
+
+    /* depth: view distance divided by the far plane, in [0, 1] */
+    static uint64_t makeKey(Layer layer, GLuint program, GLuint texture, GLuint vao, float depth);
+
+    void submit(const DrawItem& item);
+    void sort();
+    /* Execute the items of one layer, sort() must have been called */
+    void execute(GLStateCache& state, Layer layer);
+    void clear();
+
+    /* Draw calls issued since the last clear() */
+    unsigned int drawCalls() const { return draws; }
+
+private:
+    std::vector<DrawItem> items;
+    std::vector<uint64_t> keys, keysScratch;
+    std::vector<uint32_t> order, orderScratch;
+    unsigned int draws = 0;
+};
+
+#endif
@@ -0,0 +1,173 @@
+#include "asyncloader.h"
+#include <SOIL.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+// bytes copied into a mapped pixel buffer per step, a few per frame
+static const size_t STREAM_STEP_BYTES = 1 << 20;
+
+AsyncLoader::AsyncLoader(unsigned int count) {
+    if (count == 0) {
+        unsigned int threads = thread::hardware_concurrency();
+        count = threads > 1 ? threads - 1 : 1;
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        workers.emplace_back(&AsyncLoader::workerLoop, this);
+    }
+}
+
+AsyncLoader::~AsyncLoader() {
+    {
+        lock_guard<mutex> lock(jobsMutex);
+        stopping = true;
+        jobs.clear();
+    }
+    queued.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+AsyncLoader::TextureUpload::~TextureUpload() {
+    if (pbo) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        if (mapped) glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &pbo);
+    }
+    if (pixels) SOIL_free_image_data(pixels);
+}
+
+void AsyncLoader::workerLoop() {
+    while (true) {
+        Job job;
+        {
+            unique_lock<mutex> lock(jobsMutex);
+            queued.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping) return;
+            job = move(jobs.front());
+            jobs.pop_front();
+            running++;
+        }
+        try {
+            job.work();
+        } catch (...) {
+            job.error = current_exception();
+        }
+        {
+            lock_guard<mutex> lock(jobsMutex);
+            running--;
+            done.push_back(move(job));
+        }
+        completed.notify_all();
+    }
+}
+
+void AsyncLoader::run(function<void()> work, function<void()> finish) {
+    {
+        lock_guard<mutex> lock(jobsMutex);
+        jobs.push_back({move(work), move(finish), nullptr});
+    }
+    queued.notify_one();
+}
+
+GLuint AsyncLoader::loadTexture(const string& path) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    const unsigned char gray[4] = {128, 128, 128, 255};
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, gray);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    auto upload = make_shared<TextureUpload>();
+    upload->path = path;
+    upload->texture = texture;
+    // stb_image decodes reentrantly, only SOIL's error string is shared
+    run([upload] {
+        int channels;
+        upload->pixels = SOIL_load_image(upload->path.c_str(), &upload->width, &upload->height,
+                                         &channels, SOIL_LOAD_RGB);
+        if (!upload->pixels) throw runtime_error("Failed to load texture: " + upload->path);
+    }, [this, upload] {
+        streaming.push_back(upload);
+    });
+    return texture;
+}
+
+bool AsyncLoader::streamStep() {
+    TextureUpload& upload = *streaming.front();
+    size_t size = (size_t) upload.width * upload.height * 3;
+    if (!upload.pbo) {
+        glGenBuffers(1, &upload.pbo);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        upload.mapped = (unsigned char*) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                                          GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (!upload.mapped) throw runtime_error("Can't map the pixel buffer of " + upload.path);
+        return false;
+    }
+
+    if (upload.copied < size) {
+        size_t bytes = min(STREAM_STEP_BYTES, size - upload.copied);
+        memcpy(upload.mapped + upload.copied, upload.pixels + upload.copied, bytes);
+        upload.copied += bytes;
+        return false;
+    }
+
+    // the driver copies from the buffer to the texture without blocking this thread
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.pbo);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    upload.mapped = nullptr;
+    glBindTexture(GL_TEXTURE_2D, upload.texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, upload.width, upload.height, 0, GL_RGB, GL_UNSIGNED_BYTE, (void*) 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return true;
+}
+
+bool AsyncLoader::pump(double budgetMs) {
+    auto start = chrono::steady_clock::now();
+    auto withinBudget = [&] {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() < budgetMs;
+    };
+
+    do {
+        Job job;
+        {
+            lock_guard<mutex> lock(jobsMutex);
+            if (done.empty()) break;
+            job = move(done.front());
+            done.pop_front();
+        }
+        if (job.error) rethrow_exception(job.error);
+        job.finish();
+    } while (withinBudget());
+
+    if (!streaming.empty()) {
+        do {
+            if (streamStep()) streaming.pop_front();
+        } while (!streaming.empty() && withinBudget());
+    }
+    return pending() > 0;
+}
+
+void AsyncLoader::finishAll() {
+    while (pump(1e9)) {
+        unique_lock<mutex> lock(jobsMutex);
+        completed.wait(lock, [this] { return !done.empty() || (jobs.empty() && running == 0); });
+    }
+}
+
+size_t AsyncLoader::pending() const {
+    lock_guard<mutex> lock(jobsMutex);
+    return jobs.size() + running + done.size() + streaming.size();
+}
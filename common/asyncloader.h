@@ -0,0 +1,82 @@
+#ifndef ASYNC_LOADER_H
+#define ASYNC_LOADER_H
+
+#include <GL/glew.h>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+* Loads assets off the GL thread. The CPU part of a job (parsing, image
+* decoding) runs on worker threads, its GL part runs in pump() on the GL
+* thread within a time budget per frame, so startup waits for the slowest
+* asset and not for the sum of all of them.
+*
+* Textures can be used at once: they hold a 1x1 placeholder until their
+* pixels are streamed through a pixel buffer object. Destroy the loader
+* before the objects its jobs write to; unfinished jobs are dropped.
+*/
+class AsyncLoader {
+public:
+    /* workers 0: one per hardware thread but the GL one */
+    explicit AsyncLoader(unsigned int workers = 0);
+    ~AsyncLoader();
+
+    /* work on a worker thread, then finish on the GL thread in pump().
+     * An exception of work is rethrown by pump() instead of finish */
+    void run(std::function<void()> work, std::function<void()> finish);
+
+    /* GL thread. RGB, repeating, like loadSOIL() */
+    GLuint loadTexture(const std::string& path);
+
+    /* GL thread, once per frame. Finishes jobs and streams textures for
+     * about budgetMs, at least one step. Returns true while work is left */
+    bool pump(double budgetMs);
+
+    /* pump() until everything is loaded */
+    void finishAll();
+
+    /* Jobs and texture uploads not finished yet */
+    size_t pending() const;
+
+private:
+    struct Job {
+        std::function<void()> work, finish;
+        std::exception_ptr error;
+    };
+
+    // decoded pixels on their way to a texture
+    struct TextureUpload {
+        std::string path;
+        GLuint texture = 0;
+        unsigned char* pixels = nullptr;
+        int width = 0, height = 0;
+        GLuint pbo = 0;
+        unsigned char* mapped = nullptr;
+        size_t copied = 0;
+
+        ~TextureUpload();
+    };
+
+    std::vector<std::thread> workers;
+    mutable std::mutex jobsMutex;
+    std::condition_variable queued, completed;
+    std::deque<Job> jobs, done;
+    size_t running = 0;
+    bool stopping = false;
+
+    // GL thread only
+    std::deque<std::shared_ptr<TextureUpload>> streaming;
+
+    void workerLoop();
+    /* One bounded step of the front upload, true when it is complete */
+    bool streamStep();
+};
+
+#endif
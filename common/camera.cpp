@@ -7,12 +7,19 @@
 
 using namespace glm;
 
+static bool isPressed(GLFWwindow* window, int key) {
+    return window != NULL && glfwGetKey(window, key) == GLFW_PRESS;
+}
+
 Camera::Camera(GLFWwindow* window) : window(window)
 {
     position = glm::vec3(0, 10, 3);
     horizontalAngle = 3.14f;
     verticalAngle = 0.0f;
     FoV = 65.0f;
+    nearPlane = 0.1f;
+    farPlane = 200.0f;
+    aspectRatio = 4.0f / 3.0f;
     speed = 6.0f;
     mouseSpeed = 0.001f;
     fovSpeed = 2.0f;
@@ -36,75 +43,88 @@ void Camera::update()
 {
 
     // glfwGetTime is called only once, the first time this function is called
-    static double lastTime = glfwGetTime();
+    static double lastTime = window != NULL ? glfwGetTime() : 0.0;
 
     // Compute time difference between current and last frame
-    double currentTime = glfwGetTime();
+    double currentTime = window != NULL ? glfwGetTime() : lastTime;
     float deltaTime = float(currentTime - lastTime);
 
 
-    // Task 5.4: right and up vectors of the camera coordinate system
-    // use spherical coordinates
-	vec3 direction(
-		cos(verticalAngle)*sin(horizontalAngle),
-		sin(verticalAngle),
-		cos(verticalAngle)*cos(horizontalAngle)
-    );
-
-    // Right vector
-	vec3 right(
-        sin(horizontalAngle - 3.14f/2.0f),
-        0.0f,
-        cos(horizontalAngle - 3.14f / 2.0f)
-    );
-
-    // Up vector
-    vec3 up = cross(right, direction);
+    vec3 direction, right, up;
+    basis(direction, right, up);
 
     // Task 5.5: update camera position using the direction/right vectors
     // Move forward
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
+    if (isPressed(window, GLFW_KEY_W)) {
 		position += direction * deltaTime * speed;
     }
     // Move backward
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
+    if (isPressed(window, GLFW_KEY_S)) {
 		position -= direction * deltaTime * speed;
     }
     // Strafe right
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
+    if (isPressed(window, GLFW_KEY_D)) {
 		position += right * deltaTime * speed;
     }
     // Strafe left
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
+    if (isPressed(window, GLFW_KEY_A)) {
 		position -= right * deltaTime * speed;
     }
-    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS) {
+    if (isPressed(window, GLFW_KEY_E)) {
         position += up * deltaTime * speed;
         //std::cout << up.x << up.y << up.z << std::endl;
     }
-    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS) {
+    if (isPressed(window, GLFW_KEY_Q)) {
         position -= up * deltaTime * speed;
     }
 
     // Task 5.6: handle zoom in/out effects
-    if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {
+    if (isPressed(window, GLFW_KEY_UP)) {
 		FoV -= fovSpeed;
     }
-    if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {
+    if (isPressed(window, GLFW_KEY_DOWN)) {
 		FoV += fovSpeed;
 	}
 
 	
 
+    updateMatrices();
+
+    // For the next frame, the "last time" will be "now"
+    lastTime = currentTime;
+}
+
+void Camera::basis(vec3& direction, vec3& right, vec3& up) const
+{
+    // Task 5.4: right and up vectors of the camera coordinate system
+    // use spherical coordinates
+	direction = vec3(
+		cos(verticalAngle)*sin(horizontalAngle),
+		sin(verticalAngle),
+		cos(verticalAngle)*cos(horizontalAngle)
+    );
+
+    // Right vector
+	right = vec3(
+        sin(horizontalAngle - 3.14f/2.0f),
+        0.0f,
+        cos(horizontalAngle - 3.14f / 2.0f)
+    );
+
+    // Up vector
+    up = cross(right, direction);
+}
+
+void Camera::updateMatrices()
+{
+    vec3 direction, right, up;
+    basis(direction, right, up);
+
     // Task 5.7: construct projection and view matrices
-	projectionMatrix = perspective(radians(FoV), 4.0f / 3.0f, 0.1f, 200.0f);
+	projectionMatrix = perspective(radians(FoV), aspectRatio, nearPlane, farPlane);
     viewMatrix = lookAt(
 		position,
         position + direction,
 		up
     );
-    //*/
-
-    // For the next frame, the "last time" will be "now"
-    lastTime = currentTime;
 }
\ No newline at end of file
@@ -18,17 +18,29 @@ public:
     float verticalAngle;
     // Field of View
     float FoV;
+    // Clipping planes of the projection
+    float nearPlane;
+    float farPlane;
+    float aspectRatio;
 
     float speed; // units / second
     float mouseSpeed;
     float fovSpeed;
     bool active = true;
 
+    /* Without a window (headless) there is no keyboard input */
     Camera(GLFWwindow* window);
 
     void onMouseMove(double xPos, double yPos);
 
+    /* Apply keyboard input, then updateMatrices() */
     void update();
+
+    /* Recompute the view and projection matrices from the current pose */
+    void updateMatrices();
+
+private:
+    void basis(glm::vec3& direction, glm::vec3& right, glm::vec3& up) const;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,71 @@
+#include <GL/glew.h>
+#include <string>
+#include <stdexcept>
+using namespace std;
+
+#include "framebuffer.h"
+
+GLuint createAttachmentTexture(
+        GLenum internalFormat, GLenum format, GLenum type,
+        int width, int height, GLenum filter) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+void checkFramebufferStatus(const char* name) {
+    GLenum status = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        throw runtime_error(string("Framebuffer is not complete: ") + name +
+                            " (status " + to_string(status) + ")\n");
+    }
+}
+
+void copyDepth(GLuint sourceFramebuffer, GLuint targetFramebuffer,
+               int width, int height) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, sourceFramebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, targetFramebuffer);
+    // depth can only be copied with nearest filtering, multisampled sources are resolved
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+                      GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+}
+
+void drawFullscreenTriangle() {
+    // core profile needs a VAO bound even if no attributes are read
+    static GLuint emptyVAO = 0;
+    if (emptyVAO == 0) {
+        glGenVertexArrays(1, &emptyVAO);
+    }
+    glBindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+RenderTarget createRenderTarget(int width, int height) {
+    RenderTarget target;
+    target.width = width;
+    target.height = height;
+    target.color = createAttachmentTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+    target.depth = createAttachmentTexture(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL,
+                                           GL_UNSIGNED_INT_24_8, width, height);
+
+    glGenFramebuffers(1, &target.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.color, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, target.depth, 0);
+    checkFramebufferStatus("render target");
+    return target;
+}
+
+void deleteRenderTarget(RenderTarget& target) {
+    glDeleteFramebuffers(1, &target.framebuffer);
+    glDeleteTextures(1, &target.color);
+    glDeleteTextures(1, &target.depth);
+    target.framebuffer = target.color = target.depth = 0;
+}
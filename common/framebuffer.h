@@ -0,0 +1,44 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <GL/glew.h>
+
+/**
+* Create a 2D texture without mipmaps that can be used as a framebuffer
+* attachment. The texture is clamped to the edge.
+*/
+GLuint createAttachmentTexture(
+        GLenum internalFormat, GLenum format, GLenum type,
+        int width, int height, GLenum filter = GL_NEAREST);
+
+/**
+* Throw if the currently bound draw framebuffer is not complete.
+*/
+void checkFramebufferStatus(const char* name);
+
+/**
+* Copy the depth buffer of one framebuffer into another. Both depth buffers
+* must have the same format (the default framebuffer uses GL_DEPTH24_STENCIL8).
+*/
+void copyDepth(GLuint sourceFramebuffer, GLuint targetFramebuffer,
+               int width, int height);
+
+/**
+* Draw one triangle that covers the viewport. The vertex shader must compute
+* the position from gl_VertexID, see FullscreenTriangle.vertexshader.
+*/
+void drawFullscreenTriangle();
+
+/**
+* Framebuffer with an RGBA8 color and a GL_DEPTH24_STENCIL8 depth texture,
+* a stand-in for the default framebuffer when there is no window.
+*/
+struct RenderTarget {
+    GLuint framebuffer, color, depth;
+    int width, height;
+};
+
+RenderTarget createRenderTarget(int width, int height);
+void deleteRenderTarget(RenderTarget& target);
+
+#endif
@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+using namespace std;
+
+#include "framestats.h"
+
+FrameStats::FrameStats() : numSeries(0), published(0) {
+    memset(ring, 0, sizeof(ring));
+    memset(names, 0, sizeof(names));
+}
+
+int FrameStats::findSeries(const char* series) {
+    for (int i = 0; i < numSeries; i++) {
+        if (names[i] == series || strcmp(names[i], series) == 0) return i;
+    }
+    if (numSeries == MAX_SERIES) return -1;
+    names[numSeries] = series;
+    return numSeries++;
+}
+
+void FrameStats::beginFrame() {
+    // series that are not set this frame read as 0
+    unsigned int slot = published.load(memory_order_relaxed) % CAPACITY;
+    for (int i = 0; i < numSeries; i++) {
+        ring[i][slot] = 0.0f;
+    }
+}
+
+void FrameStats::set(const char* series, float ms) {
+    int index = findSeries(series);
+    if (index < 0) return;
+    unsigned int slot = published.load(memory_order_relaxed) % CAPACITY;
+    ring[index][slot] = ms;
+}
+
+void FrameStats::endFrame() {
+    published.fetch_add(1, memory_order_release);
+}
+
+int FrameStats::sampleCount() const {
+    return (int) min(published.load(memory_order_acquire), (unsigned int) CAPACITY);
+}
+
+int FrameStats::ringOffset() const {
+    unsigned int frames = published.load(memory_order_acquire);
+    return frames < CAPACITY ? 0 : frames % CAPACITY;
+}
+
+FrameStats::Summary FrameStats::summarize(int series) const {
+    Summary summary = {};
+    int count = sampleCount();
+    summary.count = count;
+    if (count == 0) return summary;
+
+    // the ring stays in frame order for plotting, select on a copy
+    memcpy(scratch, ring[series], count * sizeof(float));
+    auto percentile = [&](float p) {
+        int k = min(count - 1, (int) (p * count));
+        nth_element(scratch, scratch + k, scratch + count);
+        return scratch[k];
+    };
+    summary.min = *min_element(scratch, scratch + count);
+    summary.max = *max_element(scratch, scratch + count);
+    summary.median = percentile(0.5f);
+    summary.p95 = percentile(0.95f);
+    summary.p99 = percentile(0.99f);
+    return summary;
+}
+
+bool FrameStats::writeCSV(const string& path) const {
+    ofstream out(path);
+    if (!out.is_open()) {
+        cout << "Can't write frame stats: " << path << endl;
+        return false;
+    }
+
+    unsigned int frames = published.load(memory_order_acquire);
+    int count = sampleCount();
+    out << "frame";
+    for (int i = 0; i < numSeries; i++) {
+        out << "," << names[i];
+    }
+    out << "\n";
+    for (unsigned int frame = frames - count; frame < frames; frame++) {
+        out << frame;
+        for (int i = 0; i < numSeries; i++) {
+            out << "," << ring[i][frame % CAPACITY];
+        }
+        out << "\n";
+    }
+
+    cout << "Wrote " << count << " frames to " << path << endl;
+    return true;
+}
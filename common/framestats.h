@@ -0,0 +1,56 @@
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include <atomic>
+#include <string>
+
+/**
+* Fixed-size ring of per-frame timings (ms), one column per named series
+* (frame CPU, frame GPU, profiler zones...). Recording never allocates or
+* locks: the producer fills the slot of the current frame and publishes it
+* by bumping an atomic frame counter, readers only look at published frames.
+* A reader on another thread may still race with a slot being overwritten
+* once the ring wraps, which is fine for statistics.
+*/
+class FrameStats {
+public:
+    static const int CAPACITY = 512;
+    static const int MAX_SERIES = 16;
+
+    struct Summary {
+        float min, median, p95, p99, max;
+        int count;
+    };
+
+    FrameStats();
+
+    void beginFrame();
+    /* Ignored when MAX_SERIES series exist already */
+    void set(const char* series, float ms);
+    void endFrame();
+
+    int seriesCount() const { return numSeries; }
+    const char* seriesName(int series) const { return names[series]; }
+
+    /* Percentiles over the frames in the ring */
+    Summary summarize(int series) const;
+
+    /* Samples in ring order, plot with values_offset = ringOffset() */
+    const float* samples(int series) const { return ring[series]; }
+    int sampleCount() const;
+    int ringOffset() const;
+
+    /* Oldest frame first, one column per series */
+    bool writeCSV(const std::string& path) const;
+
+private:
+    float ring[MAX_SERIES][CAPACITY];
+    const char* names[MAX_SERIES];
+    int numSeries;
+    std::atomic<unsigned int> published;
+    mutable float scratch[CAPACITY];
+
+    int findSeries(const char* series);
+};
+
+#endif
@@ -0,0 +1,71 @@
+#include <GL/glew.h>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+#include "frameuniforms.h"
+
+FrameUniformBuffer::FrameUniformBuffer() : slot(-1), mapped(nullptr) {
+    // bound ranges must start at a multiple of the offset alignment
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    slotSize = (sizeof(FrameData) + alignment - 1) / alignment * alignment;
+    memset(fences, 0, sizeof(fences));
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    if (GLEW_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_UNIFORM_BUFFER, FRAMES * slotSize, NULL, flags);
+        mapped = (char*) glMapBufferRange(GL_UNIFORM_BUFFER, 0, FRAMES * slotSize, flags);
+    }
+    if (!mapped) {
+        glBufferData(GL_UNIFORM_BUFFER, FRAMES * slotSize, NULL, GL_DYNAMIC_DRAW);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+FrameUniformBuffer::~FrameUniformBuffer() {
+    for (GLsync fence : fences) {
+        if (fence) glDeleteSync(fence);
+    }
+    if (mapped) {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &buffer);
+}
+
+void FrameUniformBuffer::bindBlock(GLuint program) {
+    GLuint index = glGetUniformBlockIndex(program, "FrameData");
+    if (index == GL_INVALID_INDEX) {
+        cout << "Program " << program << " has no FrameData block" << endl;
+        return;
+    }
+    glUniformBlockBinding(program, index, BINDING);
+}
+
+void FrameUniformBuffer::update(const FrameData& data) {
+    // the fence covers every command of the frame that used the previous slot
+    if (slot >= 0 && mapped) {
+        if (fences[slot]) glDeleteSync(fences[slot]);
+        fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    slot = (slot + 1) % FRAMES;
+
+    if (mapped) {
+        // only blocks if the GPU is FRAMES frames behind
+        if (fences[slot]) {
+            glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(fences[slot]);
+            fences[slot] = 0;
+        }
+        memcpy(mapped + slot * slotSize, &data, sizeof(FrameData));
+    } else {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, slot * slotSize, sizeof(FrameData), &data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+    glBindBufferRange(GL_UNIFORM_BUFFER, BINDING, buffer, slot * slotSize, sizeof(FrameData));
+}
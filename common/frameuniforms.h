@@ -0,0 +1,58 @@
+#ifndef FRAME_UNIFORMS_H
+#define FRAME_UNIFORMS_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/**
+* Per-frame data shared by all programs, std140 layout of the uniform block
+*
+*   layout(std140) uniform FrameData {
+*       mat4 V; mat4 P; mat4 PV;
+*       vec4 cameraPosition; vec4 lightPosition; vec4 lightColor;
+*   };
+*
+* Keep the two in sync, every member is 16 byte aligned so the C++ struct
+* matches without padding.
+*/
+struct FrameData {
+    glm::mat4 V;
+    glm::mat4 P;
+    glm::mat4 PV;
+    glm::vec4 cameraPosition;
+    glm::vec4 lightPosition;
+    glm::vec4 lightColor;
+};
+
+/**
+* Ring of FRAMES FrameData slots in one uniform buffer. The slot of the
+* current frame is bound to BINDING. With ARB_buffer_storage the buffer is
+* persistently mapped and written directly, a fence per slot makes sure the
+* GPU is done with it before it is reused; otherwise it is updated with
+* glBufferSubData.
+*/
+class FrameUniformBuffer {
+public:
+    static const GLuint BINDING = 0;
+    static const int FRAMES = 3;
+
+    FrameUniformBuffer();
+    ~FrameUniformBuffer();
+
+    /* Point the FrameData block of the program to BINDING */
+    static void bindBlock(GLuint program);
+
+    /* Write the data of a new frame and bind its slot */
+    void update(const FrameData& data);
+
+    bool isPersistent() const { return mapped != nullptr; }
+
+private:
+    GLuint buffer;
+    GLsizeiptr slotSize;
+    int slot;
+    GLsync fences[FRAMES];
+    char* mapped;
+};
+
+#endif
@@ -0,0 +1,80 @@
+#include "frustum.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FRUSTUM_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+using namespace glm;
+
+Frustum::Frustum() {
+    for (int i = 0; i < 6; i++) {
+        planes[i] = vec4(0.0f, 0.0f, 0.0f, 1.0f); // accepts everything
+    }
+    pack();
+}
+
+Frustum::Frustum(const mat4& PV) {
+    // glm is column major, PV[c][r]
+    vec4 row0(PV[0][0], PV[1][0], PV[2][0], PV[3][0]);
+    vec4 row1(PV[0][1], PV[1][1], PV[2][1], PV[3][1]);
+    vec4 row2(PV[0][2], PV[1][2], PV[2][2], PV[3][2]);
+    vec4 row3(PV[0][3], PV[1][3], PV[2][3], PV[3][3]);
+
+    planes[0] = row3 + row0;
+    planes[1] = row3 - row0;
+    planes[2] = row3 + row1;
+    planes[3] = row3 - row1;
+    planes[4] = row3 + row2;
+    planes[5] = row3 - row2;
+
+    for (int i = 0; i < 6; i++) {
+        planes[i] /= length(vec3(planes[i]));
+    }
+    pack();
+}
+
+void Frustum::pack() {
+    for (int i = 0; i < 8; i++) {
+        for (int c = 0; c < 4; c++) {
+            packed[c][i] = planes[i % 6][c];
+        }
+    }
+}
+
+bool Frustum::intersectsAABB(const vec3& min, const vec3& max) const {
+#ifdef FRUSTUM_USE_SSE
+    // max(n * min, n * max) per axis is the dot product with the corner
+    // farthest along the normal, for four planes at once
+    __m128 minX = _mm_set1_ps(min.x), minY = _mm_set1_ps(min.y), minZ = _mm_set1_ps(min.z);
+    __m128 maxX = _mm_set1_ps(max.x), maxY = _mm_set1_ps(max.y), maxZ = _mm_set1_ps(max.z);
+    for (int i = 0; i < 8; i += 4) {
+        __m128 nx = _mm_load_ps(&packed[0][i]);
+        __m128 ny = _mm_load_ps(&packed[1][i]);
+        __m128 nz = _mm_load_ps(&packed[2][i]);
+        __m128 d = _mm_load_ps(&packed[3][i]);
+        d = _mm_add_ps(d, _mm_max_ps(_mm_mul_ps(nx, minX), _mm_mul_ps(nx, maxX)));
+        d = _mm_add_ps(d, _mm_max_ps(_mm_mul_ps(ny, minY), _mm_mul_ps(ny, maxY)));
+        d = _mm_add_ps(d, _mm_max_ps(_mm_mul_ps(nz, minZ), _mm_mul_ps(nz, maxZ)));
+        if (_mm_movemask_ps(_mm_cmplt_ps(d, _mm_setzero_ps()))) return false;
+    }
+    return true;
+#else
+    for (int i = 0; i < 6; i++) {
+        const vec4& p = planes[i];
+        // the corner farthest along the plane normal
+        vec3 positive(p.x >= 0.0f ? max.x : min.x,
+                      p.y >= 0.0f ? max.y : min.y,
+                      p.z >= 0.0f ? max.z : min.z);
+        if (dot(vec3(p), positive) + p.w < 0.0f) return false;
+    }
+    return true;
+#endif
+}
+
+bool Frustum::intersectsSphere(const vec3& center, float radius) const {
+    for (int i = 0; i < 6; i++) {
+        if (dot(vec3(planes[i]), center) + planes[i].w < -radius) return false;
+    }
+    return true;
+}
@@ -0,0 +1,32 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+/**
+* View frustum planes extracted from a projection * view matrix
+* (Gribb and Hartmann). Normals point inwards and are normalized.
+* The AABB test checks four planes at a time with SSE when available, the
+* planes are also kept in structure of arrays form for it, so they must not
+* be changed after construction.
+*/
+class Frustum
+{
+public:
+    glm::vec4 planes[6]; // left, right, bottom, top, near, far
+
+    Frustum();
+    explicit Frustum(const glm::mat4& PV);
+
+    bool intersectsAABB(const glm::vec3& min, const glm::vec3& max) const;
+
+    bool intersectsSphere(const glm::vec3& center, float radius) const;
+
+private:
+    // x, y, z, w of 8 planes, the last two repeat the first
+    alignas(16) float packed[4][8];
+
+    void pack();
+};
+
+#endif
@@ -0,0 +1,80 @@
+#include "glstate.h"
+
+// a name that is never returned by glGen*, forces the next bind
+static const GLuint UNKNOWN = 0xFFFFFFFF;
+
+GLStateCache::GLStateCache() : issuedCalls(0), skippedCalls(0) {
+    invalidate();
+}
+
+void GLStateCache::invalidate() {
+    program = UNKNOWN;
+    vao = UNKNOWN;
+    activeUnit = UNKNOWN;
+    for (int i = 0; i < MAX_TEXTURE_UNITS; i++) {
+        textures[i] = UNKNOWN;
+        targets[i] = 0;
+    }
+    // uniform values are program state, they survive unless the program is relinked
+}
+
+void GLStateCache::resetCounters() {
+    issuedCalls = 0;
+    skippedCalls = 0;
+}
+
+void GLStateCache::useProgram(GLuint newProgram) {
+    if (program == newProgram) {
+        skippedCalls++;
+        return;
+    }
+    glUseProgram(newProgram);
+    program = newProgram;
+    issuedCalls++;
+}
+
+void GLStateCache::bindVertexArray(GLuint newVAO) {
+    if (vao == newVAO) {
+        skippedCalls++;
+        return;
+    }
+    glBindVertexArray(newVAO);
+    vao = newVAO;
+    issuedCalls++;
+}
+
+void GLStateCache::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+    if (unit < MAX_TEXTURE_UNITS && textures[unit] == texture && targets[unit] == target) {
+        skippedCalls += 2;
+        return;
+    }
+    if (activeUnit != unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+        issuedCalls++;
+    } else {
+        skippedCalls++;
+    }
+    glBindTexture(target, texture);
+    issuedCalls++;
+    if (unit < MAX_TEXTURE_UNITS) {
+        textures[unit] = texture;
+        targets[unit] = target;
+    }
+}
+
+void GLStateCache::uniform1i(GLint location, GLint value) {
+    if (location < 0 || program == UNKNOWN) {
+        glUniform1i(location, value);
+        return;
+    }
+    unsigned long long key = ((unsigned long long) program << 32) | (unsigned int) location;
+    auto it = uniforms.find(key);
+    if (it != uniforms.end() && it->second == value) {
+        skippedCalls++;
+        return;
+    }
+    glUniform1i(location, value);
+    uniforms[key] = value;
+    issuedCalls++;
+}
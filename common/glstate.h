@@ -0,0 +1,38 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <GL/glew.h>
+#include <unordered_map>
+
+/**
+* Shadow copy of the bound program, VAO, textures and sampler uniforms.
+* Binds are only forwarded to the driver when they change the state.
+* Call invalidate() after code that binds state without going through the
+* cache (e.g. ImGui or the OIT passes).
+*/
+class GLStateCache {
+public:
+    static const int MAX_TEXTURE_UNITS = 16;
+
+    GLStateCache();
+
+    void invalidate();
+
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vao);
+    void bindTexture(GLuint unit, GLenum target, GLuint texture);
+    /* glUniform1i on the current program, cached per program and location */
+    void uniform1i(GLint location, GLint value);
+
+    /* Calls forwarded to / dropped before the driver since resetCounters() */
+    unsigned int issuedCalls, skippedCalls;
+    void resetCounters();
+
+private:
+    GLuint program, vao, activeUnit;
+    GLuint textures[MAX_TEXTURE_UNITS];
+    GLenum targets[MAX_TEXTURE_UNITS];
+    std::unordered_map<unsigned long long, GLint> uniforms;
+};
+
+#endif
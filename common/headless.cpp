@@ -0,0 +1,159 @@
+#include <GL/glew.h>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#ifndef _WIN32
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+using namespace std;
+
+#include "headless.h"
+
+RunOptions parseRunOptions(int argc, char** argv) {
+    RunOptions options;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--headless") {
+            options.headless = true;
+        } else if (arg == "--frames" && hasValue) {
+            options.frames = atoi(argv[++i]);
+            if (options.frames <= 0) {
+                throw runtime_error("--frames must be positive");
+            }
+        } else if (arg == "--size" && hasValue) {
+            string size = argv[++i];
+            size_t x = size.find('x');
+            if (x == string::npos) {
+                throw runtime_error("--size must be WxH, e.g. 1280x720");
+            }
+            options.width = atoi(size.substr(0, x).c_str());
+            options.height = atoi(size.substr(x + 1).c_str());
+            if (options.width <= 0 || options.height <= 0) {
+                throw runtime_error("--size must be WxH, e.g. 1280x720");
+            }
+        } else if (arg == "--csv" && hasValue) {
+            options.csvPath = argv[++i];
+        } else if (arg == "--record" && hasValue) {
+            options.recordPath = argv[++i];
+        } else if (arg == "--replay" && hasValue) {
+            options.replayPath = argv[++i];
+        } else if (arg == "--model" && hasValue) {
+            options.modelPath = argv[++i];
+        } else if (arg == "--quantize") {
+            options.quantize = true;
+        } else if (arg == "--residency" && hasValue) {
+            options.residency = argv[++i];
+            if (options.residency != "keep" && options.residency != "drop" && options.residency != "collision") {
+                throw runtime_error("--residency must be keep, drop or collision");
+            }
+        } else if (arg == "--bench-obj" && hasValue) {
+            options.benchObjPath = argv[++i];
+        } else if (arg == "--dynamic-resolution" && hasValue) {
+            options.dynamicResolutionMs = (float) atof(argv[++i]);
+            if (options.dynamicResolutionMs <= 0.0f) {
+                throw runtime_error("--dynamic-resolution must be a positive GPU time in ms");
+            }
+        } else {
+            throw runtime_error("Unknown argument: " + arg +
+                                "\nUsage: lab [--headless] [--frames N] [--size WxH] [--csv path]"
+                                " [--record path | --replay path] [--model path]"
+                                " [--dynamic-resolution ms] [--bench-obj path] [--quantize]"
+                                " [--residency keep|drop|collision]");
+        }
+    }
+    return options;
+}
+
+#ifdef _WIN32
+
+HeadlessContext::HeadlessContext(bool) : display(NULL), context(NULL) {
+    throw runtime_error("Headless mode needs EGL, it is not available on Windows");
+}
+
+HeadlessContext::~HeadlessContext() {}
+
+#else
+
+HeadlessContext::HeadlessContext(bool preferGL43) : display(NULL), context(NULL) {
+    EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+
+    // the surfaceless platform needs neither X nor a GPU device node
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (clientExtensions && strstr(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+                eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay) {
+            eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        }
+    }
+    if (eglDisplay == EGL_NO_DISPLAY) {
+        eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, NULL, NULL)) {
+        throw runtime_error("Failed to initialize EGL\n");
+    }
+    display = eglDisplay;
+
+    const char* extensions = eglQueryString(eglDisplay, EGL_EXTENSIONS);
+    if (!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context")) {
+        eglTerminate(eglDisplay);
+        throw runtime_error("EGL_KHR_surfaceless_context is not supported\n");
+    }
+
+    const EGLint configAttributes[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    EGLint numConfigs = 0;
+    if (!eglBindAPI(EGL_OPENGL_API) ||
+        !eglChooseConfig(eglDisplay, configAttributes, &config, 1, &numConfigs)) {
+        eglTerminate(eglDisplay);
+        throw runtime_error("EGL does not support desktop OpenGL\n");
+    }
+    // nothing is drawn to EGL surfaces, so a context without a config will do
+    // (Mesa's surfaceless platform has no OpenGL configs)
+    if (numConfigs == 0) {
+        config = EGL_NO_CONFIG_KHR;
+        if (!strstr(extensions, "EGL_KHR_no_config_context") && !strstr(extensions, "EGL_MESA_configless_context")) {
+            eglTerminate(eglDisplay);
+            throw runtime_error("No EGL config supports desktop OpenGL\n");
+        }
+    }
+
+    // 4.3 first when it is wanted, 3.3 if the driver has no 4.3
+    const EGLint majorVersions[] = {4, 3};
+    EGLContext eglContext = EGL_NO_CONTEXT;
+    for (int i = preferGL43 ? 0 : 1; i < 2 && eglContext == EGL_NO_CONTEXT; i++) {
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, majorVersions[i],
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+    }
+    if (eglContext == EGL_NO_CONTEXT ||
+        !eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+        eglTerminate(eglDisplay);
+        throw runtime_error("Failed to create an OpenGL 3.3 core EGL context\n");
+    }
+    context = eglContext;
+
+    // glewInit() looks for a GLX/WGL display, only load the GL entry points
+    glewExperimental = GL_TRUE;
+    if (glewContextInit() != GLEW_OK) {
+        eglTerminate(eglDisplay);
+        throw runtime_error("Failed to initialize GLEW\n");
+    }
+}
+
+HeadlessContext::~HeadlessContext() {
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <string>
+
+/**
+* Command line options of the demo:
+*   --headless        render without a window, into an offscreen framebuffer
+*   --frames N        number of frames to render in headless mode
+*   --size WxH        resolution of the rendering
+*   --csv path        write the per-frame timings when the run ends
+*   --record path     record camera and input to a replay file
+*   --replay path     play a replay file back with its recorded frame times
+*   --model path      extra .obj drawn with its meshes frustum culled
+*   --dynamic-resolution ms  scale the scene resolution to meet a GPU time
+*   --bench-obj path  time the OBJ loaders on a file and exit
+*   --quantize        upload meshes as 16 byte quantized vertices
+*   --residency mode  CPU copies kept after upload: keep, drop or collision
+*/
+struct RunOptions {
+    bool headless = false;
+    int frames = 600;
+    int width = 1024;
+    int height = 768;
+    std::string csvPath;
+    std::string recordPath;
+    std::string replayPath;
+    std::string modelPath;
+    float dynamicResolutionMs = 0.0f; // 0: native resolution
+    std::string benchObjPath;
+    bool quantize = false;
+    std::string residency = "keep"; // keep, drop or collision
+};
+
+/* Throws on unknown or malformed arguments */
+RunOptions parseRunOptions(int argc, char** argv);
+
+/**
+* OpenGL core context without any window system surface, created through
+* EGL (EGL_MESA_platform_surfaceless when available, so it also works
+* without an X server, e.g. Mesa llvmpipe on a CI machine). All rendering
+* must go to framebuffer objects. GLEW is initialized for the context.
+*/
+class HeadlessContext {
+public:
+    /* Asks for OpenGL 4.3 (compute, for the GPU-driven path) first when wanted, then 3.3 */
+    explicit HeadlessContext(bool preferGL43 = false);
+    ~HeadlessContext();
+
+private:
+    void* display;
+    void* context;
+};
+
+#endif
@@ -0,0 +1,93 @@
+#include "mappedfile.h"
+#include <stdexcept>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const string& path) : bytes(nullptr), length(0), file(nullptr), mapping(nullptr) {
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        throw runtime_error("Can't open " + path);
+    }
+    file = handle;
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(handle, &fileSize);
+    length = (size_t) fileSize.QuadPart;
+    if (length == 0) return;
+
+    mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping) {
+        bytes = (const uint8_t*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (!bytes) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(handle);
+        throw runtime_error("Can't map " + path);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (bytes) UnmapViewOfFile(bytes);
+    if (mapping) CloseHandle(mapping);
+    if (file) CloseHandle(file);
+}
+
+bool fileStatus(const string& path, uint64_t& size, int64_t& mtime) {
+    struct _stat64 status;
+    if (_stat64(path.c_str(), &status) != 0) return false;
+    size = (uint64_t) status.st_size;
+    mtime = (int64_t) status.st_mtime;
+    return true;
+}
+
+#else
+
+MappedFile::MappedFile(const string& path) : bytes(nullptr), length(0) {
+    int descriptor = open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        throw runtime_error("Can't open " + path);
+    }
+    struct stat status;
+    if (fstat(descriptor, &status) != 0) {
+        close(descriptor);
+        throw runtime_error("Can't stat " + path);
+    }
+    length = (size_t) status.st_size;
+    if (length > 0) {
+        void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (address == MAP_FAILED) {
+            close(descriptor);
+            throw runtime_error("Can't map " + path);
+        }
+        bytes = (const uint8_t*) address;
+    }
+    // the mapping keeps its own reference to the file
+    close(descriptor);
+}
+
+MappedFile::~MappedFile() {
+    if (bytes) munmap((void*) bytes, length);
+}
+
+bool fileStatus(const string& path, uint64_t& size, int64_t& mtime) {
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0) return false;
+    size = (uint64_t) status.st_size;
+    mtime = (int64_t) status.st_mtime;
+    return true;
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+* Read-only memory mapping of a whole file (mmap, or a file mapping on
+* Windows). Pages are read on first access, nothing is copied up front.
+*/
+class MappedFile {
+public:
+    /* Throws if the file can't be opened or mapped */
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /* nullptr for an empty file */
+    const uint8_t* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const uint8_t* bytes;
+    size_t length;
+#ifdef _WIN32
+    void* file;
+    void* mapping;
+#endif
+};
+
+/* Size in bytes and modification time of a file, false if it does not exist */
+bool fileStatus(const std::string& path, uint64_t& size, int64_t& mtime);
+
+#endif
@@ -0,0 +1,180 @@
+#include "meshcache.h"
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static const char MAGIC[4] = {'M', 'S', 'H', 'C'};
+static const uint32_t VERSION = 2;
+static const uint64_t ALIGNMENT = 64;
+
+static_assert(sizeof(MeshCacheHeader) == 112, "the header is written as is");
+
+// one file per variant, so loads of the same source with other flags don't replace it
+static string cachePath(const string& sourcePath, uint32_t flags) {
+    string path = sourcePath;
+    if (flags & MESH_CACHE_OPTIMIZED) path += ".optimized";
+    if (flags & MESH_CACHE_QUANTIZED) path += ".quantized";
+    return path + ".meshcache";
+}
+
+// unique per writer, loads of the same source can run on several threads and processes
+static string temporaryPath(const string& path) {
+#ifdef _WIN32
+    long long pid = _getpid();
+#else
+    long long pid = getpid();
+#endif
+    size_t threadId = hash<thread::id>()(this_thread::get_id());
+    return path + "." + to_string(pid) + "." + to_string(threadId) + ".tmp";
+}
+
+static uint64_t alignUp(uint64_t offset) {
+    return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+uint64_t hashFile(const string& path) {
+    MappedFile file(path);
+    const uint8_t* data = file.data();
+    size_t size = file.size();
+
+    // 8 bytes at a time, the tail is padded with zeros
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        h = (h ^ word) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 29;
+    }
+    uint64_t tail = 0;
+    if (i < size) memcpy(&tail, data + i, size - i);
+    h = (h ^ tail) * 0xC4CEB9FE1A85EC53ull;
+    return h ^ (h >> 32);
+}
+
+// Stores the new modification time of an unchanged source, so the next open doesn't hash it again
+static void updateSourceMtime(const string& path, int64_t sourceMtime) {
+    fstream file(path, ios::binary | ios::in | ios::out);
+    file.seekp(offsetof(MeshCacheHeader, sourceMtime));
+    file.write((const char*) &sourceMtime, sizeof(sourceMtime));
+    if (!file) cerr << "Can't update the mesh cache " << path << endl;
+}
+
+unique_ptr<MeshCache> MeshCache::open(const string& sourcePath, uint32_t vertexStride,
+                                      uint32_t flags, uint32_t flagMask) {
+    uint64_t cacheSize, sourceSize;
+    int64_t cacheMtime, sourceMtime;
+    string path = cachePath(sourcePath, flags & flagMask);
+    if (!fileStatus(path, cacheSize, cacheMtime) || cacheSize < sizeof(MeshCacheHeader)) return nullptr;
+    if (!fileStatus(sourcePath, sourceSize, sourceMtime)) return nullptr;
+
+    unique_ptr<MeshCache> cache;
+    try {
+        cache.reset(new MeshCache(path));
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        return nullptr;
+    }
+
+    const MeshCacheHeader& header = cache->header();
+    if (memcmp(header.magic, MAGIC, 4) != 0 || header.version != VERSION ||
+        header.vertexStride != vertexStride || (header.flags & flagMask) != (flags & flagMask)) {
+        return nullptr;
+    }
+    // a truncated file would fault when the arrays are read
+    if (header.vertexOffset + header.vertexCount * vertexStride > cacheSize ||
+        header.indexOffset + header.indexCount * sizeof(uint32_t) > cacheSize ||
+        header.lodOffset + header.lodCount * sizeof(LODRange) > cacheSize) {
+        return nullptr;
+    }
+    for (uint64_t i = 0; i < header.lodCount; i++) {
+        const LODRange& lod = cache->lods()[i];
+        if ((uint64_t) lod.firstIndex + lod.indexCount > header.indexCount) return nullptr;
+    }
+    if (header.sourceSize != sourceSize) return nullptr;
+    if (header.sourceMtime != sourceMtime) {
+        if (header.sourceHash != hashFile(sourcePath)) return nullptr;
+        // the mapping is closed first, Windows does not write to a mapped file
+        cache.reset();
+        updateSourceMtime(path, sourceMtime);
+        try {
+            cache.reset(new MeshCache(path));
+        } catch (const exception& e) {
+            cerr << e.what() << endl;
+            return nullptr;
+        }
+    }
+    return cache;
+}
+
+bool MeshCache::write(const string& sourcePath, uint32_t flags,
+                      const void* vertices, uint32_t vertexStride, size_t vertexCount,
+                      const uint32_t* indices, size_t indexCount,
+                      const LODRange* lods, size_t lodCount,
+                      const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+    MeshCacheHeader header = {};
+    memcpy(header.magic, MAGIC, 4);
+    header.version = VERSION;
+    header.flags = flags;
+    header.vertexStride = vertexStride;
+    if (!fileStatus(sourcePath, header.sourceSize, header.sourceMtime)) return false;
+    header.sourceHash = hashFile(sourcePath);
+    header.vertexCount = vertexCount;
+    header.indexCount = indexCount;
+    header.vertexOffset = alignUp(sizeof(MeshCacheHeader));
+    header.indexOffset = alignUp(header.vertexOffset + vertexCount * vertexStride);
+    header.lodCount = lodCount;
+    header.lodOffset = alignUp(header.indexOffset + indexCount * sizeof(uint32_t));
+    for (int c = 0; c < 3; c++) {
+        header.boundsMin[c] = boundsMin[c];
+        header.boundsMax[c] = boundsMax[c];
+    }
+
+    // written aside and renamed, a reader never sees half a file
+    string path = cachePath(sourcePath, flags);
+    string temporary = temporaryPath(path);
+    {
+        ofstream out(temporary, ios::binary | ios::trunc);
+        if (!out) {
+            cerr << "Can't write the mesh cache " << temporary << endl;
+            return false;
+        }
+        vector<char> padding(ALIGNMENT, 0);
+        out.write((const char*) &header, sizeof(header));
+        out.write(padding.data(), header.vertexOffset - sizeof(header));
+        out.write((const char*) vertices, vertexCount * vertexStride);
+        out.write(padding.data(), header.indexOffset - (header.vertexOffset + vertexCount * vertexStride));
+        out.write((const char*) indices, indexCount * sizeof(uint32_t));
+        out.write(padding.data(), header.lodOffset - (header.indexOffset + indexCount * sizeof(uint32_t)));
+        out.write((const char*) lods, lodCount * sizeof(LODRange));
+        if (!out) {
+            cerr << "Can't write the mesh cache " << temporary << endl;
+            out.close();
+            remove(temporary.c_str());
+            return false;
+        }
+    }
+#ifdef _WIN32
+    // rename does not replace an existing file there
+    remove(path.c_str());
+#endif
+    if (rename(temporary.c_str(), path.c_str()) != 0) {
+        cerr << "Can't write the mesh cache " << path << endl;
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,73 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <glm/glm.hpp>
+#include "mappedfile.h"
+#include "simplify.h"
+
+/**
+* Binary cache of an indexed mesh, stored next to its source as
+* <source>[.optimized][.quantized].meshcache after the MESH_CACHE_OPTIMIZED
+* and MESH_CACHE_QUANTIZED flags it was written with. The file is a
+* MeshCacheHeader followed by the interleaved vertices, the 32 bit indices of
+* all levels of detail and the LODRange of every level, each 64 byte aligned,
+* so the arrays can be mapped and handed to glBufferData as is.
+*
+* A cache belongs to the source size, modification time and content hash it
+* was written from. When size and time match the cache is used without
+* reading the source; when only the time changed (e.g. a fresh checkout) the
+* content hash decides, and on a match the new time is stored in the cache.
+*/
+struct MeshCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t vertexStride; // bytes
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    uint64_t sourceHash;
+    uint64_t vertexCount, indexCount;
+    uint64_t vertexOffset, indexOffset; // from the start of the file
+    float boundsMin[3], boundsMax[3];
+    uint64_t lodCount, lodOffset;
+};
+
+/* MeshCacheHeader::flags, the producer's own flags must match too */
+const uint32_t MESH_CACHE_NORMALS = 1;
+const uint32_t MESH_CACHE_UVS = 2;
+const uint32_t MESH_CACHE_OPTIMIZED = 4;
+const uint32_t MESH_CACHE_QUANTIZED = 8;
+
+class MeshCache {
+public:
+    /* The cache of sourcePath if it is up to date and was written with
+     * vertexStride and the flags in flagMask set as in flags, else nullptr */
+    static std::unique_ptr<MeshCache> open(const std::string& sourcePath, uint32_t vertexStride,
+                                           uint32_t flags, uint32_t flagMask);
+
+    /* Replace the cache of sourcePath. Prints a warning and returns false
+     * when it can't be written, the cache is only an optimization */
+    static bool write(const std::string& sourcePath, uint32_t flags,
+                      const void* vertices, uint32_t vertexStride, size_t vertexCount,
+                      const uint32_t* indices, size_t indexCount,
+                      const LODRange* lods, size_t lodCount,
+                      const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+    const MeshCacheHeader& header() const { return *(const MeshCacheHeader*) file.data(); }
+    const void* vertices() const { return file.data() + header().vertexOffset; }
+    const uint32_t* indices() const { return (const uint32_t*) (file.data() + header().indexOffset); }
+    const LODRange* lods() const { return (const LODRange*) (file.data() + header().lodOffset); }
+
+private:
+    explicit MeshCache(const std::string& path) : file(path) {}
+
+    MappedFile file;
+};
+
+/* 64 bit hash of the contents of a file */
+uint64_t hashFile(const std::string& path);
+
+#endif
@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <numeric>
+#include "meshopt.h"
+
+using namespace std;
+using namespace glm;
+
+float computeACMR(const vector<unsigned int>& indices, size_t vertexCount, int cacheSize) {
+    if (indices.size() < 3) return 0.0f;
+
+    // FIFO: a vertex is in the cache if it was inserted less than cacheSize misses ago
+    vector<size_t> insertedAt(vertexCount, 0);
+    size_t misses = 0;
+    for (unsigned int v : indices) {
+        if (insertedAt[v] == 0 || misses - insertedAt[v] >= (size_t) cacheSize) {
+            misses++;
+            insertedAt[v] = misses;
+        }
+    }
+    return (float) misses / (indices.size() / 3);
+}
+
+void optimizeVertexCache(vector<unsigned int>& indices, size_t vertexCount,
+                         int cacheSize, vector<size_t>* clusters) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) return;
+
+    // vertex -> triangles adjacency, in CSR form
+    vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (unsigned int v : indices) offsets[v + 1]++;
+    for (size_t v = 0; v < vertexCount; v++) offsets[v + 1] += offsets[v];
+    vector<unsigned int> adjacency(indices.size());
+    vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) {
+        adjacency[fill[indices[i]]++] = (unsigned int) (i / 3);
+    }
+
+    vector<unsigned int> live(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) live[v] = offsets[v + 1] - offsets[v];
+    vector<int> cacheTime(vertexCount, 0);
+    vector<bool> emitted(triangleCount, false);
+    vector<unsigned int> deadEnd, candidates, output;
+    output.reserve(indices.size());
+    if (clusters) clusters->assign(1, 0);
+
+    int time = cacheSize + 1;
+    size_t cursor = 0;
+    int fanning = 0;
+    while (fanning >= 0) {
+        candidates.clear();
+        for (unsigned int a = offsets[fanning]; a < offsets[fanning + 1]; a++) {
+            unsigned int t = adjacency[a];
+            if (emitted[t]) continue;
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = indices[3 * t + k];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - cacheTime[v] > cacheSize) {
+                    cacheTime[v] = time++;
+                }
+            }
+            emitted[t] = true;
+        }
+
+        // next fanning vertex: the candidate that will still be in cache
+        // after its remaining triangles are emitted, oldest first
+        int next = -1, priority = -1;
+        for (unsigned int v : candidates) {
+            if (live[v] == 0) continue;
+            int p = 0;
+            if (time - cacheTime[v] + 2 * (int) live[v] <= cacheSize) p = time - cacheTime[v];
+            if (p > priority) {
+                priority = p;
+                next = v;
+            }
+        }
+
+        if (next == -1) {
+            // dead end: most recent vertex with live triangles, else scan
+            while (!deadEnd.empty() && next == -1) {
+                unsigned int d = deadEnd.back();
+                deadEnd.pop_back();
+                if (live[d] > 0) next = d;
+            }
+            while (next == -1 && cursor < vertexCount) {
+                if (live[cursor] > 0) next = (int) cursor;
+                cursor++;
+            }
+            // the cache is cold anyway, a good place to start a new cluster
+            if (clusters && next != -1 && output.size() - clusters->back() >= 3 * 128) {
+                clusters->push_back(output.size());
+            }
+        }
+        fanning = next;
+    }
+
+    indices.swap(output);
+}
+
+void optimizeOverdraw(vector<unsigned int>& indices, const vector<size_t>& clusters,
+                      const vector<vec3>& positions) {
+    if (clusters.size() < 2) return;
+
+    vec3 meshCenter(0.0f);
+    for (unsigned int v : indices) meshCenter += positions[v];
+    meshCenter /= (float) indices.size();
+
+    vector<float> outwards(clusters.size());
+    for (size_t c = 0; c < clusters.size(); c++) {
+        size_t begin = clusters[c];
+        size_t end = c + 1 < clusters.size() ? clusters[c + 1] : indices.size();
+        vec3 center(0.0f), normal(0.0f);
+        for (size_t i = begin; i < end; i += 3) {
+            vec3 p0 = positions[indices[i]], p1 = positions[indices[i + 1]], p2 = positions[indices[i + 2]];
+            // unnormalized, weighted by area
+            normal += cross(p1 - p0, p2 - p0);
+            center += p0 + p1 + p2;
+        }
+        center /= (float) (end - begin);
+        float length2 = dot(normal, normal);
+        outwards[c] = length2 > 0.0f ? dot(center - meshCenter, normal / sqrt(length2)) : 0.0f;
+    }
+
+    vector<size_t> order(clusters.size());
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return outwards[a] > outwards[b]; });
+
+    vector<unsigned int> sorted;
+    sorted.reserve(indices.size());
+    for (size_t c : order) {
+        size_t begin = clusters[c];
+        size_t end = c + 1 < clusters.size() ? clusters[c + 1] : indices.size();
+        sorted.insert(sorted.end(), indices.begin() + begin, indices.begin() + end);
+    }
+    indices.swap(sorted);
+}
+
+vector<unsigned int> optimizeVertexFetch(vector<unsigned int>& indices, size_t vertexCount) {
+    vector<unsigned int> remap(vertexCount, ~0u);
+    unsigned int next = 0;
+    for (unsigned int& v : indices) {
+        if (remap[v] == ~0u) remap[v] = next++;
+        v = remap[v];
+    }
+    return remap;
+}
@@ -0,0 +1,57 @@
+#ifndef MESHOPT_H
+#define MESHOPT_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+* Average cache miss ratio: simulated post-transform cache misses per
+* triangle for a FIFO cache of cacheSize entries. 3 is the worst case,
+* 0.5 is the lower bound for regular grids.
+*/
+float computeACMR(const std::vector<unsigned int>& indices,
+                  size_t vertexCount, int cacheSize = 16);
+
+/**
+* Reorder triangles for the post-transform vertex cache with Tipsify
+* (Sander, Nehab and Barczak, "Fast triangle reordering for vertex locality
+* and reduced overdraw", 2007). Linear in the number of triangles. If
+* clusters is given it receives the first index of every cluster, the
+* triangles between two cache resets, for optimizeOverdraw().
+*/
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount,
+                         int cacheSize = 16, std::vector<size_t>* clusters = nullptr);
+
+/**
+* Sort the clusters of optimizeVertexCache() so that those facing outwards
+* from the mesh center are drawn first. They tend to be in front from any
+* view point, which reduces overdraw without view dependent sorting.
+*/
+void optimizeOverdraw(std::vector<unsigned int>& indices,
+                      const std::vector<size_t>& clusters,
+                      const std::vector<glm::vec3>& positions);
+
+/**
+* Renumber vertices in the order they are first referenced so that vertex
+* fetch reads memory linearly. Rewrites indices and returns the table
+* old vertex -> new vertex (~0u for unreferenced vertices), apply it to every
+* attribute with remapVertices().
+*/
+std::vector<unsigned int> optimizeVertexFetch(std::vector<unsigned int>& indices,
+                                              size_t vertexCount);
+
+template <typename T>
+void remapVertices(std::vector<T>& vertices, const std::vector<unsigned int>& remap) {
+    if (vertices.empty()) return;
+    size_t used = 0;
+    for (unsigned int target : remap) {
+        if (target != ~0u) used++;
+    }
+    std::vector<T> remapped(used);
+    for (size_t i = 0; i < remap.size(); i++) {
+        if (remap[i] != ~0u) remapped[remap[i]] = vertices[i];
+    }
+    vertices.swap(remapped);
+}
+
+#endif
@@ -0,0 +1,28 @@
+#include "parallel.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+size_t parallelChunks(size_t count, size_t minChunk) {
+    size_t threads = max(1u, thread::hardware_concurrency());
+    size_t chunks = count / max<size_t>(minChunk, 1);
+    return max<size_t>(1, min(chunks, threads));
+}
+
+void parallelFor(size_t count, size_t chunks,
+                 const function<void(size_t, size_t, size_t)>& body) {
+    chunks = max<size_t>(chunks, 1);
+    auto range = [&](size_t chunk) {
+        body(chunk, count * chunk / chunks, count * (chunk + 1) / chunks);
+    };
+
+    vector<thread> workers;
+    workers.reserve(chunks - 1);
+    for (size_t chunk = 0; chunk + 1 < chunks; chunk++) {
+        workers.emplace_back(range, chunk);
+    }
+    range(chunks - 1);
+    for (auto& worker : workers) worker.join();
+}
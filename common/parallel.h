@@ -0,0 +1,23 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+/**
+* Number of chunks to split count items into so that each has at least
+* minChunk items, at most one per hardware thread. At least 1.
+*/
+size_t parallelChunks(size_t count, size_t minChunk);
+
+/**
+* Split [0, count) into chunks contiguous ranges of about the same size and
+* call body(chunk, begin, end) for each, one thread per chunk. The calling
+* thread runs the last chunk and returns when all are done. The ranges only
+* depend on count and chunks, so per chunk results can be merged in chunk
+* order deterministically.
+*/
+void parallelFor(size_t count, size_t chunks,
+                 const std::function<void(size_t chunk, size_t begin, size_t end)>& body);
+
+#endif
@@ -0,0 +1,187 @@
+#include <GL/glew.h>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+using namespace std;
+
+#include "profiler.h"
+
+Profiler profiler;
+
+// events kept while capturing, about 32 MB
+static const size_t MAX_TRACE_EVENTS = 1 << 20;
+
+Profiler::Profiler()
+        : origin(chrono::steady_clock::now()), openGpuZone(-1), frame(0),
+          frameStartUs(0.0), lastFrameCpuMs(0.0f), lastFrameGpuMs(0.0f),
+          capturing(false) {}
+
+double Profiler::nowUs() const {
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - origin).count();
+}
+
+int Profiler::findCpuZone(const char* name) {
+    // few zones, usually the same string literal: compare pointers first
+    for (int i = 0; i < (int) cpuZones.size(); i++) {
+        if (cpuZones[i].name == name || strcmp(cpuZones[i].name, name) == 0) return i;
+    }
+    cpuZones.push_back({name, 0.0f, 0.0f});
+    return (int) cpuZones.size() - 1;
+}
+
+int Profiler::findGpuZone(const char* name) {
+    for (int i = 0; i < (int) gpuZones.size(); i++) {
+        if (gpuZones[i].name == name || strcmp(gpuZones[i].name, name) == 0) return i;
+    }
+    GpuZone zone = {};
+    zone.name = name;
+    for (int i = 0; i < GPU_QUERY_LATENCY; i++) {
+        glGenQueries(1, &zone.ring[i].query);
+    }
+    gpuZones.push_back(zone);
+    return (int) gpuZones.size() - 1;
+}
+
+void Profiler::beginFrame() {
+    frameStartUs = nowUs();
+    collectGpuResults();
+}
+
+void Profiler::endFrame() {
+    double endUs = nowUs();
+    lastFrameCpuMs = (float) ((endUs - frameStartUs) / 1000.0);
+    for (auto& zone : cpuZones) {
+        zone.lastFrameMs = zone.frameMs;
+        zone.frameMs = 0.0f;
+    }
+    if (capturing && events.size() < MAX_TRACE_EVENTS) {
+        events.push_back({"Frame", frameStartUs, endUs - frameStartUs, 0});
+    }
+    frame++;
+}
+
+void Profiler::beginCpuZone(const char* name) {
+    openZones.push_back({findCpuZone(name), nowUs()});
+}
+
+void Profiler::endCpuZone() {
+    if (openZones.empty()) return;
+    OpenZone open = openZones.back();
+    openZones.pop_back();
+
+    double durationUs = nowUs() - open.startUs;
+    cpuZones[open.zone].frameMs += (float) (durationUs / 1000.0);
+    if (capturing && events.size() < MAX_TRACE_EVENTS) {
+        events.push_back({cpuZones[open.zone].name, open.startUs, durationUs, 0});
+    }
+}
+
+void Profiler::beginGpuZone(const char* name) {
+    if (openGpuZone >= 0) {
+        cout << "Profiler: GPU zone " << name << " nested in " << gpuZones[openGpuZone].name << endl;
+        return;
+    }
+    int index = findGpuZone(name);
+    GpuQuery& query = gpuZones[index].ring[frame % GPU_QUERY_LATENCY];
+    // the GPU is more than GPU_QUERY_LATENCY frames behind, skip instead of waiting
+    if (query.pending) return;
+
+    glBeginQuery(GL_TIME_ELAPSED, query.query);
+    query.pending = true;
+    query.startUs = nowUs();
+    query.frame = frame;
+    openGpuZone = index;
+}
+
+void Profiler::endGpuZone() {
+    if (openGpuZone < 0) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    openGpuZone = -1;
+}
+
+void Profiler::collectGpuResults() {
+    unsigned long long newestFrame = 0;
+    float frameGpuMs = 0.0f;
+    for (auto& zone : gpuZones) {
+        for (auto& query : zone.ring) {
+            if (!query.pending) continue;
+            GLint available = 0;
+            glGetQueryObjectiv(query.query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) continue;
+
+            GLuint64 elapsedNs = 0;
+            glGetQueryObjectui64v(query.query, GL_QUERY_RESULT, &elapsedNs);
+            query.pending = false;
+            if (query.frame >= zone.lastFrame) {
+                zone.lastMs = (float) (elapsedNs / 1e6);
+                zone.lastFrame = query.frame;
+            }
+            if (capturing && events.size() < MAX_TRACE_EVENTS) {
+                // GPU start is unknown, the CPU submit time is a good enough anchor
+                events.push_back({zone.name, query.startUs, elapsedNs / 1000.0, 1});
+            }
+        }
+        newestFrame = max(newestFrame, zone.lastFrame);
+    }
+    // the GPU time of the most recent frame with results
+    for (auto& zone : gpuZones) {
+        if (zone.lastFrame == newestFrame) frameGpuMs += zone.lastMs;
+    }
+    lastFrameGpuMs = frameGpuMs;
+}
+
+float Profiler::cpuZoneTime(const char* name) const {
+    for (const auto& zone : cpuZones) {
+        if (zone.name == name || strcmp(zone.name, name) == 0) return zone.lastFrameMs;
+    }
+    return 0.0f;
+}
+
+float Profiler::gpuZoneTime(const char* name) const {
+    for (const auto& zone : gpuZones) {
+        if (zone.name == name || strcmp(zone.name, name) == 0) return zone.lastMs;
+    }
+    return 0.0f;
+}
+
+void Profiler::startCapture() {
+    events.clear();
+    events.reserve(64 * 1024);
+    capturing = true;
+}
+
+void Profiler::stopCapture() {
+    capturing = false;
+}
+
+bool Profiler::writeChromeTrace(const string& path) const {
+    ofstream out(path);
+    if (!out.is_open()) {
+        cout << "Can't write trace file: " << path << endl;
+        return false;
+    }
+
+    // complete events ("ph": "X"), timestamps in microseconds
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"CPU\"}},\n";
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"GPU\"}}";
+    out.precision(3);
+    out << fixed;
+    for (const auto& event : events) {
+        out << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.track
+            << ",\"ts\":" << event.startUs << ",\"dur\":" << event.durationUs << "}";
+    }
+    out << "\n]}\n";
+
+    cout << "Wrote " << events.size() << " trace events to " << path << endl;
+    return true;
+}
+
+void Profiler::release() {
+    for (auto& zone : gpuZones) {
+        for (auto& query : zone.ring) {
+            glDeleteQueries(1, &query.query);
+        }
+    }
+    gpuZones.clear();
+}
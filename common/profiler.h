@@ -0,0 +1,116 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <GL/glew.h>
+#include <vector>
+#include <string>
+#include <chrono>
+
+/**
+* Frame profiler with nestable CPU zones and GPU zones timed by
+* GL_TIME_ELAPSED queries. Each GPU zone owns a ring of queries that is read
+* back a few frames later, only once the result is available, so the CPU
+* never waits for the GPU. GPU zones can not be nested (one GL_TIME_ELAPSED
+* query can be active at a time), use one per render pass.
+*
+* While capturing, every zone is recorded and can be written as a Chrome /
+* Perfetto trace (chrome://tracing, https://ui.perfetto.dev).
+*/
+class Profiler {
+public:
+    static const int GPU_QUERY_LATENCY = 4; // frames in flight per GPU zone
+
+    Profiler();
+
+    void beginFrame();
+    void endFrame();
+
+    void beginCpuZone(const char* name);
+    void endCpuZone();
+
+    void beginGpuZone(const char* name);
+    void endGpuZone();
+
+    /* Milliseconds spent in a zone during the last frame that has results */
+    float cpuZoneTime(const char* name) const;
+    float gpuZoneTime(const char* name) const;
+    float lastFrameCpuTime() const { return lastFrameCpuMs; }
+    float lastFrameGpuTime() const { return lastFrameGpuMs; }
+
+    /* Zones seen so far, in order of first use */
+    int cpuZoneCount() const { return (int) cpuZones.size(); }
+    const char* cpuZoneName(int zone) const { return cpuZones[zone].name; }
+    int gpuZoneCount() const { return (int) gpuZones.size(); }
+    const char* gpuZoneName(int zone) const { return gpuZones[zone].name; }
+
+    void startCapture();
+    void stopCapture();
+    bool isCapturing() const { return capturing; }
+    bool writeChromeTrace(const std::string& path) const;
+
+    /* Delete the GL queries, call before the context is destroyed */
+    void release();
+
+private:
+    struct CpuZone {
+        const char* name;
+        float frameMs, lastFrameMs;
+    };
+    struct OpenZone {
+        int zone;
+        double startUs;
+    };
+    struct GpuQuery {
+        GLuint query;
+        bool pending;
+        double startUs;
+        unsigned long long frame;
+    };
+    struct GpuZone {
+        const char* name;
+        GpuQuery ring[GPU_QUERY_LATENCY];
+        float lastMs;
+        unsigned long long lastFrame;
+    };
+    struct TraceEvent {
+        const char* name;
+        double startUs, durationUs;
+        int track; // 0 CPU, 1 GPU
+    };
+
+    std::chrono::steady_clock::time_point origin;
+    std::vector<CpuZone> cpuZones;
+    std::vector<OpenZone> openZones;
+    std::vector<GpuZone> gpuZones;
+    std::vector<TraceEvent> events;
+    int openGpuZone;
+    unsigned long long frame;
+    double frameStartUs;
+    float lastFrameCpuMs, lastFrameGpuMs;
+    bool capturing;
+
+    double nowUs() const;
+    int findCpuZone(const char* name);
+    int findGpuZone(const char* name);
+    void collectGpuResults();
+};
+
+extern Profiler profiler;
+
+/* RAII zones: PROFILE_CPU_SCOPE("Emitter update"); PROFILE_GPU_SCOPE("Scene"); */
+struct CpuProfileScope {
+    CpuProfileScope(const char* name) { profiler.beginCpuZone(name); }
+    ~CpuProfileScope() { profiler.endCpuZone(); }
+};
+
+struct GpuProfileScope {
+    GpuProfileScope(const char* name) { profiler.beginGpuZone(name); }
+    ~GpuProfileScope() { profiler.endGpuZone(); }
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_CPU_SCOPE(name) CpuProfileScope PROFILE_CONCAT(cpuProfileScope, __LINE__)(name)
+#define PROFILE_GPU_SCOPE(name) GpuProfileScope PROFILE_CONCAT(gpuProfileScope, __LINE__)(name)
+
+#endif
@@ -0,0 +1,92 @@
+#include "quantize.h"
+#include <cmath>
+#include <glm/gtc/packing.hpp>
+
+using namespace std;
+using namespace glm;
+
+static vec2 signNotZero(vec2 v) {
+    return vec2(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+}
+
+vec2 encodeOctahedral(vec3 n) {
+    float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (l1 == 0.0f) return vec2(0.0f);
+    n /= l1;
+    vec2 e(n.x, n.y);
+    // the lower hemisphere is folded over the diagonals
+    if (n.z < 0.0f) e = (vec2(1.0f) - abs(vec2(e.y, e.x))) * signNotZero(e);
+    return e;
+}
+
+vec3 decodeOctahedral(vec2 e) {
+    vec3 n(e.x, e.y, 1.0f - std::fabs(e.x) - std::fabs(e.y));
+    if (n.z < 0.0f) {
+        vec2 folded = (vec2(1.0f) - abs(vec2(n.y, n.x))) * signNotZero(vec2(n.x, n.y));
+        n.x = folded.x;
+        n.y = folded.y;
+    }
+    return normalize(n);
+}
+
+static uint16_t toUnorm16(float value) {
+    return (uint16_t) std::lround(clamp(value, 0.0f, 1.0f) * 65535.0f);
+}
+
+static int16_t toSnorm16(float value) {
+    return (int16_t) std::lround(clamp(value, -1.0f, 1.0f) * 32767.0f);
+}
+
+vector<QuantizedVertex> quantizeVertices(
+        const vector<vec3>& positions,
+        const vector<vec3>& normals,
+        const vector<vec2>& uvs,
+        const vec3& boundsMin, const vec3& boundsMax,
+        VertexQuantization& quantization) {
+    vec3 extent = boundsMax - boundsMin;
+    quantization.offset = boundsMin;
+    quantization.scale = extent;
+    quantization.octahedralNormals = true;
+
+    vector<QuantizedVertex> quantized(positions.size());
+    for (size_t v = 0; v < positions.size(); v++) {
+        QuantizedVertex& vertex = quantized[v];
+        for (int c = 0; c < 3; c++) {
+            vertex.position[c] = extent[c] > 0.0f ? toUnorm16((positions[v][c] - boundsMin[c]) / extent[c]) : 0;
+        }
+        vertex.position[3] = 0;
+        vec2 normal = v < normals.size() ? encodeOctahedral(normals[v]) : vec2(0.0f);
+        vertex.normal[0] = toSnorm16(normal.x);
+        vertex.normal[1] = toSnorm16(normal.y);
+        vec2 uv = v < uvs.size() ? uvs[v] : vec2(0.0f);
+        vertex.uv[0] = packHalf1x16(uv.x);
+        vertex.uv[1] = packHalf1x16(uv.y);
+    }
+    return quantized;
+}
+
+void bindQuantizedAttributes(bool normals, bool uvs) {
+    GLsizei stride = sizeof(QuantizedVertex);
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*) offsetof(QuantizedVertex, position));
+    glEnableVertexAttribArray(0);
+    if (normals) {
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, (void*) offsetof(QuantizedVertex, normal));
+        glEnableVertexAttribArray(1);
+    }
+    if (uvs) {
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*) offsetof(QuantizedVertex, uv));
+        glEnableVertexAttribArray(2);
+    }
+}
+
+DequantizeUniforms DequantizeUniforms::locate(GLuint program) {
+    DequantizeUniforms uniforms;
+    uniforms.offset = glGetUniformLocation(program, "positionOffset");
+    uniforms.scale = glGetUniformLocation(program, "positionScale");
+    return uniforms;
+}
+
+void DequantizeUniforms::upload(const VertexQuantization& quantization) const {
+    if (offset >= 0) glUniform3fv(offset, 1, &quantization.offset[0]);
+    if (scale >= 0) glUniform3fv(scale, 1, &quantization.scale[0]);
+}
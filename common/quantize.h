@@ -0,0 +1,57 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/**
+* Compact interleaved vertex, 16 bytes instead of 32:
+*   position  unorm16 x3 relative to the mesh bounds (+ 2 bytes of padding)
+*   normal    octahedral encoding, snorm16 x2
+*   uv        half float x2
+* The vertex shaders undo the position mapping with VertexQuantization.
+*/
+struct QuantizedVertex {
+    uint16_t position[4];
+    int16_t normal[2];
+    uint16_t uv[2];
+};
+
+/* position = offset + stored * scale, the identity for float vertices */
+struct VertexQuantization {
+    glm::vec3 offset = glm::vec3(0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+    bool octahedralNormals = false;
+};
+
+/* Octahedral mapping of a unit vector to [-1, 1]^2 */
+glm::vec2 encodeOctahedral(glm::vec3 n);
+glm::vec3 decodeOctahedral(glm::vec2 e);
+
+/* normals and uvs may be empty */
+std::vector<QuantizedVertex> quantizeVertices(
+        const std::vector<glm::vec3>& positions,
+        const std::vector<glm::vec3>& normals,
+        const std::vector<glm::vec2>& uvs,
+        const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+        VertexQuantization& quantization);
+
+/* Attribute pointers 0, 1 and 2 for QuantizedVertex in the bound GL_ARRAY_BUFFER */
+void bindQuantizedAttributes(bool normals, bool uvs);
+
+/**
+* Locations of the dequantization uniforms of a vertex shader
+* (positionOffset, positionScale), -1 if it has none.
+*/
+struct DequantizeUniforms {
+    GLint offset = -1, scale = -1;
+
+    static DequantizeUniforms locate(GLuint program);
+    /* For the program in use */
+    void upload(const VertexQuantization& quantization) const;
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include <sstream>
+#include <stdexcept>
+using namespace std;
+
+#include "replay.h"
+#include "camera.h"
+
+InputReplay::InputReplay(Mode mode, const string& path, unsigned int seed)
+        : mode(mode), seed(seed), headerWritten(false), nextFrame(0) {
+    if (mode == RECORD) {
+        out.open(path);
+        if (!out.is_open()) {
+            throw runtime_error("Can't write replay: " + path);
+        }
+        // the pose must survive the round trip exactly
+        out.precision(9);
+    } else {
+        load(path);
+    }
+}
+
+void InputReplay::bindInput(const char* name, InputType type, void* value) {
+    inputs.push_back({name, type, value});
+}
+
+void InputReplay::bind(const char* name, float* value) { bindInput(name, FLOAT_INPUT, value); }
+void InputReplay::bind(const char* name, int* value) { bindInput(name, INT_INPUT, value); }
+void InputReplay::bind(const char* name, bool* value) { bindInput(name, BOOL_INPUT, value); }
+
+void InputReplay::keyEvent(int key, int action) {
+    if (mode != RECORD) return;
+    pendingKeys.push_back(key);
+    pendingKeys.push_back(action);
+}
+
+void InputReplay::recordFrame(float time, const Camera& camera) {
+    if (mode != RECORD) return;
+    if (!headerWritten) {
+        out << "replay 2 " << seed << "\ninputs";
+        for (const auto& input : inputs) out << " " << input.name;
+        out << "\n";
+        headerWritten = true;
+    }
+
+    out << "frame " << time << " " << camera.position.x << " " << camera.position.y << " "
+        << camera.position.z << " " << camera.horizontalAngle << " " << camera.verticalAngle
+        << " " << camera.FoV;
+    for (const auto& input : inputs) {
+        switch (input.type) {
+            case FLOAT_INPUT: out << " " << *(float*) input.value; break;
+            case INT_INPUT: out << " " << *(int*) input.value; break;
+            case BOOL_INPUT: out << " " << (*(bool*) input.value ? 1 : 0); break;
+        }
+    }
+    out << " " << pendingKeys.size() / 2;
+    for (int value : pendingKeys) out << " " << value;
+    out << "\n";
+    pendingKeys.clear();
+}
+
+void InputReplay::load(const string& path) {
+    ifstream in(path);
+    if (!in.is_open()) {
+        throw runtime_error("Can't open replay: " + path);
+    }
+
+    string line, tag;
+    int version = 0;
+    if (!getline(in, line) || !(istringstream(line) >> tag >> version >> seed) ||
+        tag != "replay" || (version != 1 && version != 2)) {
+        throw runtime_error("Not a replay file: " + path);
+    }
+    if (getline(in, line)) {
+        istringstream header(line);
+        header >> tag;
+        string name;
+        while (header >> name) recordedInputs.push_back(name);
+    }
+
+    while (getline(in, line)) {
+        if (line.empty()) continue;
+        istringstream fields(line);
+        Frame frame;
+        fields >> tag >> frame.time >> frame.position.x >> frame.position.y >> frame.position.z
+               >> frame.horizontalAngle >> frame.verticalAngle >> frame.FoV;
+        frame.inputs.resize(recordedInputs.size());
+        for (float& value : frame.inputs) fields >> value;
+        int keyCount = 0;
+        fields >> keyCount;
+        frame.keys.resize(2 * keyCount);
+        for (int& value : frame.keys) fields >> value;
+        if (fields.fail() || tag != "frame") {
+            throw runtime_error("Corrupt replay frame " + to_string(frames.size()) + " in " + path);
+        }
+        frames.push_back(frame);
+    }
+}
+
+float InputReplay::playFrame(Camera& camera, void (*onKey)(int key, int action)) {
+    if (mode != PLAY || frames.empty()) return 0.0f;
+    if (finished()) return frames.back().time;
+    const Frame& frame = frames[nextFrame++];
+
+    // keys first, the recorded inputs already include their effect
+    for (size_t i = 0; i + 1 < frame.keys.size(); i += 2) {
+        onKey(frame.keys[i], frame.keys[i + 1]);
+    }
+    for (size_t i = 0; i < recordedInputs.size(); i++) {
+        for (const auto& input : inputs) {
+            if (input.name != recordedInputs[i]) continue;
+            switch (input.type) {
+                case FLOAT_INPUT: *(float*) input.value = frame.inputs[i]; break;
+                case INT_INPUT: *(int*) input.value = (int) frame.inputs[i]; break;
+                case BOOL_INPUT: *(bool*) input.value = frame.inputs[i] != 0.0f; break;
+            }
+        }
+    }
+
+    camera.position = frame.position;
+    camera.horizontalAngle = frame.horizontalAngle;
+    camera.verticalAngle = frame.verticalAngle;
+    camera.FoV = frame.FoV;
+    camera.updateMatrices();
+
+    return frame.time;
+}
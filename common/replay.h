@@ -0,0 +1,76 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <glm/glm.hpp>
+
+class Camera;
+
+/**
+* Records the camera pose, key events and a set of bound input variables
+* (UI sliders, toggles...) every frame, or plays a recording back with the
+* recorded frame times so that two runs render exactly the same frames,
+* whatever their frame rate. The seed of rand() is part of the recording.
+*
+* Text format (version 1 files also store a frame time after the seed, it is ignored):
+*   replay 2 <seed>
+*   inputs <name>...
+*   frame <time> <position xyz> <horizontal> <vertical> <FoV> <input values> <key count> (<key> <action>)...
+*/
+class InputReplay {
+public:
+    enum Mode { RECORD, PLAY };
+
+    /* Throws if the file can't be opened or is not a valid recording */
+    InputReplay(Mode mode, const std::string& path, unsigned int seed = 0);
+
+    /* Inputs are matched by name on playback, unknown names are skipped */
+    void bind(const char* name, float* value);
+    void bind(const char* name, int* value);
+    void bind(const char* name, bool* value);
+
+    bool isPlaying() const { return mode == PLAY; }
+    unsigned int getSeed() const { return seed; }
+
+    /* Recording: keys are stored with the next recorded frame */
+    void keyEvent(int key, int action);
+    void recordFrame(float time, const Camera& camera);
+
+    /* Playback: sets the bound inputs and the camera pose of the next frame,
+     * passes its key events to onKey and returns its recorded time */
+    float playFrame(Camera& camera, void (*onKey)(int key, int action));
+    bool finished() const { return nextFrame >= (int) frames.size(); }
+    int frameCount() const { return (int) frames.size(); }
+
+private:
+    enum InputType { FLOAT_INPUT, INT_INPUT, BOOL_INPUT };
+    struct Input {
+        std::string name;
+        InputType type;
+        void* value;
+    };
+    struct Frame {
+        float time;
+        glm::vec3 position;
+        float horizontalAngle, verticalAngle, FoV;
+        std::vector<float> inputs;
+        std::vector<int> keys; // key, action pairs
+    };
+
+    Mode mode;
+    unsigned int seed;
+    std::vector<Input> inputs;
+    std::ofstream out;
+    bool headerWritten;
+    std::vector<int> pendingKeys;
+    std::vector<std::string> recordedInputs;
+    std::vector<Frame> frames;
+    int nextFrame;
+
+    void bindInput(const char* name, InputType type, void* value);
+    void load(const std::string& path);
+};
+
+#endif
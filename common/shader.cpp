@@ -91,5 +91,32 @@ GLuint loadShaders(const char* vertexFilePath,
 
     cout << "Shader program complete." << endl;
 
+    return programID;
+}
+
+GLuint loadComputeShader(const char* computeFilePath) {
+    GLuint computeShaderID = glCreateShader(GL_COMPUTE_SHADER);
+    compileShader(computeShaderID, computeFilePath);
+
+    cout << "Linking shaders... " << endl;
+    GLuint programID = glCreateProgram();
+    glAttachShader(programID, computeShaderID);
+    glLinkProgram(programID);
+
+    GLint result = GL_FALSE;
+    int infoLogLength;
+    glGetProgramiv(programID, GL_LINK_STATUS, &result);
+    glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &infoLogLength);
+    if (infoLogLength > 0) {
+        std::vector<char> programErrorMessage(infoLogLength + 1);
+        glGetProgramInfoLog(programID, infoLogLength, NULL, &programErrorMessage[0]);
+        cout << &programErrorMessage[0] << endl;
+    }
+
+    glDetachShader(programID, computeShaderID);
+    glDeleteShader(computeShaderID);
+
+    cout << "Shader program complete." << endl;
+
     return programID;
 }
\ No newline at end of file
@@ -5,4 +5,7 @@ GLuint loadShaders(const char* vertexFilePath,
                    const char* fragmentFilePath,
                    const char* geometryFilePath = nullptr);
 
+/* Needs OpenGL 4.3 or ARB_compute_shader */
+GLuint loadComputeShader(const char* computeFilePath);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,298 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include "simplify.h"
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+/* Sum of squared distances to planes, weighted by triangle area */
+struct Quadric {
+    double a00 = 0, a11 = 0, a22 = 0, a01 = 0, a12 = 0, a02 = 0;
+    double b0 = 0, b1 = 0, b2 = 0, c = 0;
+    double weight = 0;
+
+    void addPlane(const vec3& n, double d, double w) {
+        a00 += w * n.x * n.x; a11 += w * n.y * n.y; a22 += w * n.z * n.z;
+        a01 += w * n.x * n.y; a12 += w * n.y * n.z; a02 += w * n.x * n.z;
+        b0 += w * n.x * d; b1 += w * n.y * d; b2 += w * n.z * d;
+        c += w * d * d;
+        weight += w;
+    }
+
+    void add(const Quadric& q) {
+        a00 += q.a00; a11 += q.a11; a22 += q.a22;
+        a01 += q.a01; a12 += q.a12; a02 += q.a02;
+        b0 += q.b0; b1 += q.b1; b2 += q.b2;
+        c += q.c;
+        weight += q.weight;
+    }
+
+    /* Mean squared distance of p to the planes */
+    double evaluate(const vec3& p) const {
+        double x = p.x, y = p.y, z = p.z;
+        double e = a00 * x * x + a11 * y * y + a22 * z * z
+                   + 2 * (a01 * x * y + a12 * y * z + a02 * x * z)
+                   + 2 * (b0 * x + b1 * y + b2 * z) + c;
+        return weight > 0 ? std::max(e, 0.0) / weight : 0.0;
+    }
+};
+
+struct Collapse {
+    unsigned int from, to;
+    double cost;
+};
+
+class Simplifier {
+public:
+    Simplifier(const vector<unsigned int>& indices, const vector<vec3>& positions,
+               const vector<vec3>& normals, const vector<vec2>& uvs)
+            : indices(indices), positions(positions), normals(normals), uvs(uvs) {
+        groupPositions();
+        lockBorders();
+        computeQuadrics();
+    }
+
+    /* Collapse until at most targetIndexCount indices remain or nothing can collapse */
+    void simplify(size_t targetIndexCount) {
+        while (indices.size() > targetIndexCount) {
+            if (!collapsePass(targetIndexCount)) break;
+        }
+    }
+
+    const vector<unsigned int>& current() const { return indices; }
+    float error() const { return (float) std::sqrt(maxCost); }
+
+private:
+    vector<unsigned int> indices;
+    const vector<vec3>& positions;
+    const vector<vec3>& normals;
+    const vector<vec2>& uvs;
+
+    // vertices at the same position share a group, topology is tracked on groups
+    vector<unsigned int> group;
+    vector<bool> locked;     // per group
+    vector<Quadric> quadrics; // per group
+    vector<unsigned int> offsets, adjacency; // group -> triangles, CSR
+    double maxCost = 0;
+
+    void groupPositions() {
+        vector<unsigned int> order(positions.size());
+        iota(order.begin(), order.end(), 0);
+        auto less = [&](unsigned int a, unsigned int b) {
+            const vec3& p = positions[a];
+            const vec3& q = positions[b];
+            return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z < q.z;
+        };
+        sort(order.begin(), order.end(), less);
+
+        group.assign(positions.size(), 0);
+        vector<unsigned int> groupSize;
+        for (size_t i = 0; i < order.size(); i++) {
+            if (i == 0 || positions[order[i]] != positions[order[i - 1]]) groupSize.push_back(0);
+            group[order[i]] = (unsigned int) groupSize.size() - 1;
+            groupSize.back()++;
+        }
+        // a seam keeps its position, the vertices on both sides must stay together
+        locked.assign(groupSize.size(), false);
+        for (size_t g = 0; g < groupSize.size(); g++) locked[g] = groupSize[g] > 1;
+    }
+
+    void lockBorders() {
+        // an edge without its opposite is on a border, one with duplicates is non manifold
+        vector<uint64_t> edges;
+        edges.reserve(indices.size());
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            for (int k = 0; k < 3; k++) {
+                uint64_t a = group[indices[t + k]], b = group[indices[t + (k + 1) % 3]];
+                edges.push_back(a << 32 | b);
+            }
+        }
+        sort(edges.begin(), edges.end());
+        for (size_t i = 0; i < edges.size(); i++) {
+            uint64_t a = edges[i] >> 32, b = edges[i] & 0xFFFFFFFFu;
+            bool duplicate = (i > 0 && edges[i - 1] == edges[i]) || (i + 1 < edges.size() && edges[i + 1] == edges[i]);
+            if (duplicate || !binary_search(edges.begin(), edges.end(), b << 32 | a)) {
+                locked[a] = true;
+                locked[b] = true;
+            }
+        }
+    }
+
+    void computeQuadrics() {
+        quadrics.assign(locked.size(), Quadric());
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            vec3 p0 = positions[indices[t]], p1 = positions[indices[t + 1]], p2 = positions[indices[t + 2]];
+            vec3 n = cross(p1 - p0, p2 - p0);
+            float area = length(n);
+            if (area == 0.0f) continue;
+            n /= area;
+            for (int k = 0; k < 3; k++) {
+                quadrics[group[indices[t + k]]].addPlane(n, -dot(n, p0), area * 0.5);
+            }
+        }
+    }
+
+    void buildAdjacency() {
+        offsets.assign(locked.size() + 1, 0);
+        for (unsigned int v : indices) offsets[group[v] + 1]++;
+        for (size_t g = 0; g < locked.size(); g++) offsets[g + 1] += offsets[g];
+        adjacency.resize(indices.size());
+        vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++) {
+            adjacency[fill[group[indices[i]]]++] = (unsigned int) (i / 3);
+        }
+    }
+
+    double cost(unsigned int from, unsigned int to) const {
+        Quadric q = quadrics[group[from]];
+        q.add(quadrics[group[to]]);
+        double e = q.evaluate(positions[to]);
+        // attributes change over the span of the collapsed edge
+        double attributes = 0;
+        if (!normals.empty()) {
+            vec3 d = normals[from] - normals[to];
+            attributes += dot(d, d);
+        }
+        if (!uvs.empty()) {
+            vec2 d = uvs[from] - uvs[to];
+            attributes += dot(d, d);
+        }
+        vec3 edge = positions[from] - positions[to];
+        return e + attributes * dot(edge, edge);
+    }
+
+    void ringGroups(unsigned int g, vector<unsigned int>& ring) const {
+        ring.clear();
+        for (unsigned int a = offsets[g]; a < offsets[g + 1]; a++) {
+            unsigned int t = adjacency[a];
+            for (int k = 0; k < 3; k++) {
+                unsigned int n = group[indices[3 * t + k]];
+                if (n != g) ring.push_back(n);
+            }
+        }
+        sort(ring.begin(), ring.end());
+        ring.erase(unique(ring.begin(), ring.end()), ring.end());
+    }
+
+    /* Moving from onto to keeps the surface manifold and flips no triangle */
+    bool valid(unsigned int from, unsigned int to, const vector<unsigned int>& fromRing,
+               const vector<unsigned int>& toRing) const {
+        // link condition: the edge only shares the two opposite vertices
+        size_t common = 0;
+        for (size_t i = 0, j = 0; i < fromRing.size() && j < toRing.size();) {
+            if (fromRing[i] < toRing[j]) i++;
+            else if (toRing[j] < fromRing[i]) j++;
+            else { common++; i++; j++; }
+        }
+        if (common != 2) return false;
+
+        unsigned int g = group[from], target = group[to];
+        for (unsigned int a = offsets[g]; a < offsets[g + 1]; a++) {
+            const unsigned int* tri = &indices[3 * adjacency[a]];
+            if (group[tri[0]] == target || group[tri[1]] == target || group[tri[2]] == target) continue;
+            vec3 before[3], after[3];
+            for (int k = 0; k < 3; k++) {
+                before[k] = positions[tri[k]];
+                after[k] = tri[k] == from ? positions[to] : before[k];
+            }
+            vec3 n0 = cross(before[1] - before[0], before[2] - before[0]);
+            vec3 n1 = cross(after[1] - after[0], after[2] - after[0]);
+            if (dot(n0, n1) <= 0.0f) return false;
+        }
+        return true;
+    }
+
+    /* One batch of independent collapses, cheapest first. False if none was possible */
+    bool collapsePass(size_t targetIndexCount) {
+        buildAdjacency();
+
+        // every directed edge once, from the triangle where it has this winding
+        vector<Collapse> collapses;
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            for (int k = 0; k < 3; k++) {
+                unsigned int from = indices[t + k], to = indices[t + (k + 1) % 3];
+                if (locked[group[from]]) continue;
+                collapses.push_back({from, to, cost(from, to)});
+            }
+        }
+        sort(collapses.begin(), collapses.end(),
+             [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+        // an interior collapse removes two triangles
+        size_t needed = (indices.size() - targetIndexCount + 5) / 6;
+        vector<unsigned int> remap(positions.size());
+        iota(remap.begin(), remap.end(), 0);
+        vector<bool> touched(locked.size(), false);
+        vector<unsigned int> fromRing, toRing;
+        size_t done = 0;
+        for (const Collapse& c : collapses) {
+            if (done >= needed) break;
+            unsigned int g = group[c.from], target = group[c.to];
+            if (touched[g] || touched[target]) continue;
+            ringGroups(g, fromRing);
+            ringGroups(target, toRing);
+            if (!valid(c.from, c.to, fromRing, toRing)) continue;
+
+            remap[c.from] = c.to;
+            quadrics[target].add(quadrics[g]);
+            maxCost = std::max(maxCost, c.cost);
+            // the triangles around both ends changed, their next collapse waits for the next pass
+            touched[g] = true;
+            touched[target] = true;
+            for (unsigned int n : fromRing) touched[n] = true;
+            done++;
+        }
+        if (done == 0) return false;
+
+        size_t out = 0;
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            unsigned int a = remap[indices[t]], b = remap[indices[t + 1]], c = remap[indices[t + 2]];
+            if (group[a] == group[b] || group[b] == group[c] || group[a] == group[c]) continue;
+            indices[out++] = a;
+            indices[out++] = b;
+            indices[out++] = c;
+        }
+        indices.resize(out);
+        return true;
+    }
+};
+
+}
+
+vector<MeshLOD> buildLODChain(const vector<unsigned int>& indices, const vector<vec3>& positions,
+                              const vector<vec3>& normals, const vector<vec2>& uvs,
+                              int simplifiedLevels, float ratio) {
+    vector<MeshLOD> chain;
+    chain.push_back({indices, 0.0f});
+
+    // the quadrics keep accumulating, so the error of a level bounds all collapses up to it
+    Simplifier simplifier(indices, positions, normals, uvs);
+    for (int level = 0; level < simplifiedLevels; level++) {
+        size_t previous = chain.back().indices.size();
+        size_t target = (size_t) (previous / 3 * ratio) * 3;
+        simplifier.simplify(target);
+        if (simplifier.current().size() * 5 > previous * 4) break;
+        chain.push_back({simplifier.current(), simplifier.error()});
+    }
+    return chain;
+}
+
+LODSelector::LODSelector(const vec3& eye, float fovY, float viewportHeight, float thresholdPixels)
+        : eye(eye), pixelsPerUnit(viewportHeight / (2.0f * std::tan(fovY * 0.5f))),
+          thresholdPixels(thresholdPixels) {}
+
+int LODSelector::select(const vector<LODRange>& lods, const vec3& center, float radius) const {
+    // inside the sphere nothing can be coarser than the full mesh
+    float distance = length(center - eye) - radius;
+    if (distance <= 0.0f) return 0;
+    int level = 0;
+    for (int i = 1; i < (int) lods.size(); i++) {
+        if (lods[i].error * pixelsPerUnit / distance > thresholdPixels) break;
+        level = i;
+    }
+    return level;
+}
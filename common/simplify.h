@@ -0,0 +1,53 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+* A level of detail of an indexed mesh. It indexes the vertices of the full
+* mesh, so all levels share one vertex buffer. error is the geometric error
+* of the simplification in model units.
+*/
+struct MeshLOD {
+    std::vector<unsigned int> indices;
+    float error;
+};
+
+/**
+* Level 0 is the input, every next level is simplified to about ratio of the
+* triangles of the previous one with quadric error metrics (Garland and
+* Heckbert, "Surface simplification using quadric error metrics", 1997)
+* through half edge collapses. Vertices on borders and attribute seams
+* (several vertices at one position) are locked. Normals and uvs, either
+* may be empty, add their change to the collapse cost. The chain ends
+* early when a level can't remove a fifth of the triangles.
+*/
+std::vector<MeshLOD> buildLODChain(const std::vector<unsigned int>& indices,
+                                   const std::vector<glm::vec3>& positions,
+                                   const std::vector<glm::vec3>& normals,
+                                   const std::vector<glm::vec2>& uvs,
+                                   int simplifiedLevels = 4, float ratio = 0.5f);
+
+/* The indices of a level in an index buffer holding all levels */
+struct LODRange {
+    unsigned int firstIndex, indexCount;
+    float error;
+};
+
+/**
+* Picks the coarsest level whose error, projected at the nearest point of
+* the bounding sphere of the mesh, stays under thresholdPixels.
+*/
+struct LODSelector {
+    glm::vec3 eye;
+    float pixelsPerUnit; // viewport height / (2 tan(fovY / 2)), pixels of one unit at distance 1
+    float thresholdPixels;
+
+    LODSelector(const glm::vec3& eye, float fovY, float viewportHeight, float thresholdPixels = 1.0f);
+
+    /* Index into lods, errors ascending as in a chain of buildLODChain */
+    int select(const std::vector<LODRange>& lods, const glm::vec3& center, float radius) const;
+};
+
+#endif
@@ -0,0 +1,395 @@
+#include "vtkdata.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include "parallel.h"
+#ifdef VTP_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+using namespace std;
+using namespace tinyxml2;
+
+namespace {
+
+enum Scalar {
+    SCALAR_INT8, SCALAR_UINT8, SCALAR_INT16, SCALAR_UINT16, SCALAR_INT32, SCALAR_UINT32,
+    SCALAR_INT64, SCALAR_UINT64, SCALAR_FLOAT32, SCALAR_FLOAT64
+};
+
+Scalar parseScalar(const char* type, const string& path) {
+    static const char* names[] = {"Int8", "UInt8", "Int16", "UInt16", "Int32", "UInt32",
+                                  "Int64", "UInt64", "Float32", "Float64"};
+    for (int s = 0; s <= SCALAR_FLOAT64; s++) {
+        if (type && strcmp(type, names[s]) == 0) return (Scalar) s;
+    }
+    throw runtime_error(path + ": unsupported DataArray type " + (type ? type : "(none)"));
+}
+
+size_t scalarSize(Scalar scalar) {
+    static const size_t sizes[] = {1, 1, 2, 2, 4, 4, 8, 8, 4, 8};
+    return sizes[scalar];
+}
+
+bool littleEndianHost() {
+    uint16_t one = 1;
+    uint8_t first;
+    memcpy(&first, &one, 1);
+    return first == 1;
+}
+
+// parallelFor that rethrows the first exception of a chunk on the calling thread
+void checkedParallelFor(size_t count, size_t chunks, const function<void(size_t, size_t, size_t)>& body) {
+    chunks = max<size_t>(chunks, 1);
+    vector<exception_ptr> errors(chunks);
+    parallelFor(count, chunks, [&](size_t chunk, size_t begin, size_t end) {
+        try {
+            body(chunk, begin, end);
+        } catch (...) {
+            errors[chunk] = current_exception();
+        }
+    });
+    for (auto& error : errors) {
+        if (error) rethrow_exception(error);
+    }
+}
+
+size_t encodedLength(size_t bytes) {
+    return (bytes + 2) / 3 * 4;
+}
+
+int sextet(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+/* chars is a multiple of 4, only the last group may be padded */
+vector<uint8_t> decodeBase64(const char* text, size_t chars, const string& path) {
+    if (chars % 4 != 0) throw runtime_error(path + ": truncated base64 data");
+    size_t groups = chars / 4;
+    size_t padding = 0;
+    if (groups > 0 && text[chars - 1] == '=') padding = text[chars - 2] == '=' ? 2 : 1;
+    vector<uint8_t> bytes(groups * 3);
+    checkedParallelFor(groups, parallelChunks(groups, 1 << 16), [&](size_t, size_t begin, size_t end) {
+        for (size_t g = begin; g < end; g++) {
+            const char* c = text + 4 * g;
+            bool last = g + 1 == groups;
+            int s0 = sextet(c[0]), s1 = sextet(c[1]);
+            int s2 = last && padding == 2 ? 0 : sextet(c[2]);
+            int s3 = last && padding > 0 ? 0 : sextet(c[3]);
+            if ((s0 | s1 | s2 | s3) < 0) throw runtime_error(path + ": invalid base64 data");
+            uint32_t triple = (uint32_t) s0 << 18 | (uint32_t) s1 << 12 | (uint32_t) s2 << 6 | (uint32_t) s3;
+            bytes[3 * g] = (uint8_t) (triple >> 16);
+            bytes[3 * g + 1] = (uint8_t) (triple >> 8);
+            bytes[3 * g + 2] = (uint8_t) triple;
+        }
+    });
+    bytes.resize(bytes.size() - padding);
+    return bytes;
+}
+
+/* Inline base64 without whitespace. Some writers wrap it in lines, it is
+ * only copied when they did */
+string_view unwrapBase64(const char* text, string& storage) {
+    auto space = [](char c) { return isspace((unsigned char) c) != 0; };
+    string_view view = text ? text : "";
+    while (!view.empty() && space(view.front())) view.remove_prefix(1);
+    while (!view.empty() && space(view.back())) view.remove_suffix(1);
+    if (none_of(view.begin(), view.end(), space)) return view;
+    storage.reserve(view.size());
+    for (char c : view) {
+        if (!space(c)) storage.push_back(c);
+    }
+    return storage;
+}
+
+template <typename S>
+S loadScalar(const uint8_t* p, bool swap) {
+    uint8_t bytes[sizeof(S)];
+    memcpy(bytes, p, sizeof(S));
+    if (swap) reverse(bytes, bytes + sizeof(S));
+    S value;
+    memcpy(&value, bytes, sizeof(S));
+    return value;
+}
+
+template <typename T, typename S>
+void convertRange(const uint8_t* data, bool swap, T* values, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        values[i] = (T) loadScalar<S>(data + i * sizeof(S), swap);
+    }
+}
+
+template <typename T>
+vector<T> convert(const uint8_t* data, size_t size, Scalar scalar, bool swap) {
+    size_t count = size / scalarSize(scalar);
+    vector<T> values(count);
+    checkedParallelFor(count, parallelChunks(count, 1 << 16), [&](size_t, size_t begin, size_t end) {
+        T* out = values.data();
+        switch (scalar) {
+            case SCALAR_INT8: convertRange<T, int8_t>(data, swap, out, begin, end); break;
+            case SCALAR_UINT8: convertRange<T, uint8_t>(data, swap, out, begin, end); break;
+            case SCALAR_INT16: convertRange<T, int16_t>(data, swap, out, begin, end); break;
+            case SCALAR_UINT16: convertRange<T, uint16_t>(data, swap, out, begin, end); break;
+            case SCALAR_INT32: convertRange<T, int32_t>(data, swap, out, begin, end); break;
+            case SCALAR_UINT32: convertRange<T, uint32_t>(data, swap, out, begin, end); break;
+            case SCALAR_INT64: convertRange<T, int64_t>(data, swap, out, begin, end); break;
+            case SCALAR_UINT64: convertRange<T, uint64_t>(data, swap, out, begin, end); break;
+            case SCALAR_FLOAT32: convertRange<T, float>(data, swap, out, begin, end); break;
+            case SCALAR_FLOAT64: convertRange<T, double>(data, swap, out, begin, end); break;
+        }
+    });
+    return values;
+}
+
+// ascii values are read at full precision, then converted
+template <typename T>
+using Parsed = conditional_t<is_floating_point<T>::value, double, int64_t>;
+
+/* Whitespace separated numbers, each chunk parses the tokens starting in it */
+template <typename T>
+vector<T> parseASCII(const char* text, size_t size, const string& path) {
+    size_t chunks = parallelChunks(size, 1 << 20);
+    vector<vector<T>> parts(chunks);
+    checkedParallelFor(size, chunks, [&](size_t chunk, size_t begin, size_t end) {
+        size_t i = begin;
+        // a token cut by begin belongs to the previous chunk
+        if (i > 0) {
+            while (i < size && !isspace((unsigned char) text[i - 1])) i++;
+        }
+        while (true) {
+            while (i < size && isspace((unsigned char) text[i])) i++;
+            if (i >= end || i >= size) break;
+            Parsed<T> value;
+            auto parsed = from_chars(text + i, text + size, value);
+            if (parsed.ec != errc()) throw runtime_error(path + ": malformed number in ascii DataArray");
+            parts[chunk].push_back((T) value);
+            i = parsed.ptr - text;
+        }
+    });
+    vector<T> values;
+    size_t count = 0;
+    for (const auto& part : parts) count += part.size();
+    values.reserve(count);
+    for (const auto& part : parts) values.insert(values.end(), part.begin(), part.end());
+    return values;
+}
+
+}
+
+VTKDataReader::VTKDataReader(const string& path) : path(path), file(path) {
+    const char* text = (const char*) file.data();
+    string_view content(text ? text : "", file.size());
+
+    // raw appended data is not XML, the parser only sees what comes before it
+    string xml;
+    size_t tag = content.find("<AppendedData");
+    if (tag != string_view::npos) {
+        size_t close = content.find('>', tag);
+        size_t underscore = close == string_view::npos ? close : content.find('_', close);
+        if (underscore == string_view::npos) throw runtime_error(path + ": malformed AppendedData");
+        string_view attributes = content.substr(tag, close - tag);
+        appendedBase64 = attributes.find("\"base64\"") != string_view::npos;
+        appended = text + underscore + 1;
+        appendedSize = content.size() - underscore - 1;
+        xml.assign(content.substr(0, tag));
+        xml += "</VTKFile>";
+    } else {
+        xml.assign(content);
+    }
+    if (document.Parse(xml.c_str(), xml.size()) != 0) throw runtime_error(path + ": can't parse the XML");
+
+    rootElement = document.FirstChildElement("VTKFile");
+    if (!rootElement) throw runtime_error(path + ": not a VTK XML file");
+    const char* headerType = rootElement->Attribute("header_type");
+    headerBytes = headerType && strcmp(headerType, "UInt64") == 0 ? 8 : 4;
+    const char* byteOrder = rootElement->Attribute("byte_order");
+    bool bigEndian = byteOrder && strcmp(byteOrder, "BigEndian") == 0;
+    swapBytes = bigEndian == littleEndianHost();
+    const char* compressor = rootElement->Attribute("compressor");
+    if (compressor && *compressor) {
+        if (strcmp(compressor, "vtkZLibDataCompressor") != 0) {
+            throw runtime_error(path + ": unsupported compressor " + compressor);
+        }
+        compressed = true;
+    }
+}
+
+const XMLElement* VTKDataReader::findArray(const XMLElement* parent, const char* name) {
+    if (!parent) return nullptr;
+    for (const XMLElement* array = parent->FirstChildElement("DataArray"); array;
+         array = array->NextSiblingElement("DataArray")) {
+        const char* arrayName = array->Attribute("Name");
+        const char* components = array->Attribute("NumberOfComponents");
+        if (name ? arrayName && strcmp(arrayName, name) == 0 : components && atoi(components) == 3) {
+            return array;
+        }
+    }
+    return nullptr;
+}
+
+uint64_t VTKDataReader::headerWord(const uint8_t* p) const {
+    return headerBytes == 8 ? loadScalar<uint64_t>(p, swapBytes) : loadScalar<uint32_t>(p, swapBytes);
+}
+
+template <typename T>
+vector<T> VTKDataReader::read(const XMLElement* array) const {
+    if (!array) throw runtime_error(path + ": missing DataArray");
+    Scalar scalar = parseScalar(array->Attribute("type"), path);
+    const char* format = array->Attribute("format");
+    string_view kind = format ? format : "ascii";
+
+    if (kind == "ascii") {
+        const char* text = array->GetText();
+        return text ? parseASCII<T>(text, strlen(text), path) : vector<T>();
+    }
+    Payload payload;
+    if (kind == "binary") {
+        string storage;
+        string_view text = unwrapBase64(array->GetText(), storage);
+        payload = decode(text.data(), text.size(), true);
+    } else if (kind == "appended") {
+        const char* offsetText = array->Attribute("offset");
+        uint64_t offset = offsetText ? strtoull(offsetText, nullptr, 10) : 0;
+        if (!appended || offset > appendedSize) throw runtime_error(path + ": appended offset out of range");
+        payload = decode(appended + offset, appendedSize - offset, appendedBase64);
+    } else {
+        throw runtime_error(path + ": unsupported DataArray format " + string(kind));
+    }
+    return convert<T>(payload.data, payload.size, scalar, swapBytes);
+}
+
+vector<float> VTKDataReader::readFloats(const XMLElement* array) const {
+    return read<float>(array);
+}
+
+vector<int64_t> VTKDataReader::readIntegers(const XMLElement* array) const {
+    return read<int64_t>(array);
+}
+
+VTKDataReader::Payload VTKDataReader::decode(const char* text, size_t size, bool base64) const {
+    string truncated = path + ": truncated DataArray";
+
+    if (!base64) {
+        const uint8_t* bytes = (const uint8_t*) text;
+        if (size < (compressed ? 3 : 1) * headerBytes) throw runtime_error(truncated);
+        if (compressed) {
+            uint64_t blocks = headerWord(bytes);
+            if (blocks > size / headerBytes - 3) throw runtime_error(truncated);
+            size_t headerSize = (3 + blocks) * headerBytes;
+            return inflate(bytes, bytes + headerSize, size - headerSize);
+        }
+        uint64_t length = headerWord(bytes);
+        if (length > size - headerBytes) throw runtime_error(truncated);
+        Payload payload;
+        payload.data = bytes + headerBytes;
+        payload.size = length;
+        return payload;
+    }
+
+    // inline text starts with the indentation
+    while (size > 0 && isspace((unsigned char) *text)) {
+        text++;
+        size--;
+    }
+    // the fixed words first, then the whole header once the block count is known
+    size_t fixedChars = encodedLength((compressed ? 3 : 1) * headerBytes);
+    if (fixedChars > size) throw runtime_error(truncated);
+    vector<uint8_t> header = decodeBase64(text, fixedChars, path);
+    if (header.size() < (compressed ? 3 : 1) * headerBytes) throw runtime_error(truncated);
+    uint64_t blocks = compressed ? headerWord(header.data()) : 0;
+    if (blocks > size) throw runtime_error(truncated);
+    size_t headerSize = ((compressed ? 3 : 1) + blocks) * headerBytes;
+    size_t headerChars = encodedLength(headerSize);
+    if (headerChars > size) throw runtime_error(truncated);
+    header = decodeBase64(text, headerChars, path);
+    if (header.size() < headerSize) throw runtime_error(truncated);
+
+    uint64_t length = 0;
+    if (compressed) {
+        for (uint64_t b = 0; b < blocks; b++) length += headerWord(header.data() + (3 + b) * headerBytes);
+    } else {
+        length = headerWord(header.data());
+    }
+    if (length > size) throw runtime_error(truncated);
+
+    // VTK encodes the header on its own, padded; others in one stream with the data.
+    // Without padding the two agree
+    Payload payload;
+    size_t skip = 0;
+    if (text[headerChars - 1] == '=' || headerSize % 3 == 0) {
+        size_t chars = encodedLength(length);
+        if (chars > size - headerChars) throw runtime_error(truncated);
+        payload.owned = decodeBase64(text + headerChars, chars, path);
+    } else {
+        size_t chars = encodedLength(headerSize + length);
+        if (chars > size) throw runtime_error(truncated);
+        payload.owned = decodeBase64(text, chars, path);
+        skip = headerSize;
+    }
+    if (payload.owned.size() < skip + length) throw runtime_error(truncated);
+    if (compressed) return inflate(header.data(), payload.owned.data() + skip, length);
+    payload.data = payload.owned.data() + skip;
+    payload.size = length;
+    return payload;
+}
+
+VTKDataReader::Payload VTKDataReader::inflate(const uint8_t* header, const uint8_t* blocks, size_t available) const {
+    uint64_t count = headerWord(header);
+    uint64_t blockSize = headerWord(header + headerBytes);
+    uint64_t lastSize = headerWord(header + 2 * headerBytes);
+    string corrupt = path + ": corrupt compressed block";
+    vector<uint64_t> offsets(count + 1, 0);
+    for (uint64_t b = 0; b < count; b++) {
+        uint64_t blockBytes = headerWord(header + (3 + b) * headerBytes);
+        if (blockBytes > available - offsets[b]) throw runtime_error(path + ": truncated compressed DataArray");
+        offsets[b + 1] = offsets[b] + blockBytes;
+    }
+
+    // the sizes come from the file, check them before allocating
+    size_t total = 0;
+    if (count > 0) {
+        if (blockSize == 0 || lastSize > blockSize) throw runtime_error(corrupt);
+        if (count - 1 > SIZE_MAX / blockSize) throw runtime_error(corrupt);
+        uint64_t full = (count - 1) * blockSize;
+        uint64_t last = lastSize ? lastSize : blockSize;
+        if (full > SIZE_MAX - last) throw runtime_error(corrupt);
+        total = (size_t) (full + last);
+        // deflate expands at most 1032 to 1
+        if (total / 1032 > offsets[count]) throw runtime_error(corrupt);
+    }
+
+    Payload payload;
+    payload.owned.resize(total);
+    payload.data = payload.owned.data();
+    payload.size = total;
+#ifdef VTP_WITH_ZLIB
+    // blocks inflate independently, each into its place
+    checkedParallelFor(count, parallelChunks(count, 1), [&](size_t, size_t begin, size_t end) {
+        for (size_t b = begin; b < end; b++) {
+            uLongf expected = (uLongf) (b + 1 == count && lastSize ? lastSize : blockSize);
+            uLongf written = expected;
+            int result = uncompress(payload.owned.data() + b * blockSize, &written, blocks + offsets[b],
+                                    (uLong) (offsets[b + 1] - offsets[b]));
+            if (result != Z_OK || written != expected) {
+                throw runtime_error(corrupt);
+            }
+        }
+    });
+#else
+    (void) blocks;
+    if (count > 0) throw runtime_error(path + ": compressed DataArray, build with VTP_WITH_ZLIB");
+#endif
+    return payload;
+}
@@ -0,0 +1,70 @@
+#ifndef VTK_DATA_H
+#define VTK_DATA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <tinyxml2.h>
+#include "mappedfile.h"
+
+/**
+* Reads the DataArray elements of a VTK XML file (.vtp): ascii, base64
+* inline ("binary") and appended data, raw or base64, with UInt32 or UInt64
+* headers, in either byte order. The file is memory mapped and the raw
+* appended section never goes through the XML parser.
+*
+* Arrays are decoded and converted in chunks on parallelFor threads. Blocks
+* compressed with vtkZLibDataCompressor are inflated in parallel when built
+* with VTP_WITH_ZLIB (and linked with zlib), otherwise reading them throws.
+*/
+class VTKDataReader {
+public:
+    /* Throws if the file can't be mapped or parsed or is not a VTKFile */
+    explicit VTKDataReader(const std::string& path);
+
+    VTKDataReader(const VTKDataReader&) = delete;
+    VTKDataReader& operator=(const VTKDataReader&) = delete;
+
+    /* The VTKFile element */
+    const tinyxml2::XMLElement* root() const { return rootElement; }
+
+    /* All components of a DataArray, converted from its type. Throw on malformed data */
+    std::vector<float> readFloats(const tinyxml2::XMLElement* array) const;
+    std::vector<int64_t> readIntegers(const tinyxml2::XMLElement* array) const;
+
+    /* Child DataArray of parent with this Name, or without a name the first
+     * one with 3 components. nullptr if there is none */
+    static const tinyxml2::XMLElement* findArray(const tinyxml2::XMLElement* parent, const char* name);
+
+private:
+    std::string path;
+    MappedFile file;
+    tinyxml2::XMLDocument document;
+    const tinyxml2::XMLElement* rootElement;
+
+    // the bytes after the '_' of AppendedData, offsets of the arrays are relative to it
+    const char* appended = nullptr;
+    size_t appendedSize = 0;
+    bool appendedBase64 = false;
+    size_t headerBytes = 4;
+    bool compressed = false;
+    bool swapBytes = false;
+
+    /* Bytes of a binary array, data points into owned or into the mapped file */
+    struct Payload {
+        std::vector<uint8_t> owned;
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+    };
+
+    template <typename T>
+    std::vector<T> read(const tinyxml2::XMLElement* array) const;
+    /* Bytes of a binary or appended array, text is base64 or raw */
+    Payload decode(const char* text, size_t size, bool base64) const;
+    /* header: block count, block size, last block size, compressed sizes */
+    Payload inflate(const uint8_t* header, const uint8_t* blocks, size_t available) const;
+    uint64_t headerWord(const uint8_t* p) const;
+};
+
+#endif
@@ -1,6 +1,7 @@
 // Include C++ headers
 #include <iostream>
 #include <string>
+#include <ctime>
 
 // Include GLEW
 #include <GL/glew.h>
@@ -20,6 +21,26 @@
 #include <texture.h>
 #include "FountainEmitter.h"
 #include "OrbitEmitter.h"
+#include "EmitterManager.h"
+
+//Use the emitters composed from policies (PolicyEmitter.h) instead of the virtual ones
+//#define USE_POLICY_EMITTERS
+#ifdef USE_POLICY_EMITTERS
+#include "PolicyEmitter.h"
+#endif
+#include "OITRenderer.h"
+#include "LowResParticlePass.h"
+#include "RenderQueue.h"
+#include "GPUDrivenRenderer.h"
+#include "DynamicResolution.h"
+#include "AssetRegistry.h"
+#include <common/profiler.h>
+#include <common/framestats.h>
+#include <common/framebuffer.h>
+#include <common/headless.h>
+#include <common/replay.h>
+#include <common/frameuniforms.h>
+#include <common/asyncloader.h>
 
 
 
@@ -40,11 +61,15 @@ void initialize();
 void createContext();
 void mainLoop();
 void free();
-void renderTerrainScene();
+void printTimingReport(int frames, double seconds);
+bool keepRunning(int frame);
+void submitTerrainScene(RenderQueue& queue);
 void renderSkydome();
 void displayGL();
 void windXManipulation();
 void windZManipulation();
+struct EmitterDrawData;
+void submitEmitter(RenderQueue& queue, IntParticleEmitter& emitter, EmitterDrawData& drawData, GLuint texture, GLuint program, GLuint samplerLocation);
 
 #define W_WIDTH 1024
 #define W_HEIGHT 768
@@ -53,14 +78,17 @@ void windZManipulation();
 // Global variables
 GLFWwindow* window;
 Camera* camera;
-GLuint particleShaderProgram, normalShaderProgram, terrainShaderProgram;
-GLuint projectionMatrixLocation, viewMatrixLocation, modelMatrixLocation, projectionAndViewMatrix;
-GLuint translationMatrixLocation, rotationMatrixLocation, scaleMatrixLocation;
-GLuint sceneTexture, waterSampler, waterTexture, sceneSampler, cloudTexture, cloudSampler;
+GLuint particleShaderProgram, particleOITShaderProgram, normalShaderProgram, terrainShaderProgram;
+GLuint oitSamplerLocation;
+GLuint waterSampler, sceneSampler, cloudSampler;
+TextureHandle sceneTexture, waterTexture, cloudTexture;
 
 
 particleAttributes particle;
 
+//Off-screen and distant emitters sleep
+EmitterManager emitterManager;
+
 //Lighting for terrain
 GLfloat g_LighDir[] = { 1.0f, 1.0f, 1.0f, 0.0f };
 GLfloat g_LightAmbient[] = { 0.1f, 0.1f, 0.1f, 1.0f };
@@ -75,31 +103,125 @@ glm::vec3 slider_emitter_pos(0.0f, 60.0f, 0.0f);
 int particles_slider = 50;
 
 void pollKeyboard(GLFWwindow* window, int key, int scancode, int action, int mods);
+void handleKey(int key, int action);
 
 bool game_paused = false;
 
 bool use_sorting = false;
 bool use_rotations = false;
+//How the particles are blended into the scene
+enum ParticleMode { PARTICLES_FORWARD, PARTICLES_OIT, PARTICLES_LOW_RES };
+int particle_mode = PARTICLES_FORWARD;
+//Weighted blended transparency, particles are drawn unsorted after the scene
+OITRenderer* oit;
+//Particles are drawn off-screen at 1/factor of the resolution after the scene
+LowResParticlePass* lowResParticles;
+int low_res_factor_item = 1; //0 full, 1 half, 2 quarter
+
+//Draws are submitted to the queue, sorted and executed through the state cache
+RenderQueue renderQueue;
+GLStateCache glState;
+
+//Frames left to record into the Chrome trace, 0 when not capturing
+int trace_frames_left = 0;
+const int TRACE_FRAMES = 120;
+//Per frame CPU/GPU timings of the last FrameStats::CAPACITY frames
+FrameStats frameStats;
+
+//Command line options, --headless renders into offscreenTarget without a window
+RunOptions options;
+HeadlessContext* headlessContext = nullptr;
+RenderTarget offscreenTarget = {};
+GLuint sceneFramebuffer = 0;
+
+//--record/--replay: camera path, keys and UI inputs of a run
+InputReplay* replay = nullptr;
+
+//Seconds since the first call, works without GLFW
+double elapsedSeconds() {
+	static auto start = std::chrono::steady_clock::now();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
 
 //float height_threshold = W_HEIGHT / 2.0f;
 float height_threshold = 1.0f;
 
-//Model Scene Load
-GLuint modelVAO, modelVerticiesVBO, planeVAO, planeVerticiesVBO;
-std::vector<vec3> modelVertices, modelNormals;
-std::vector<vec2> modelUVs;
-GLuint MVPLocation, MLocation;
+//Model Scene Load, indexed and reordered for the vertex cache
+MeshHandle scene;
+GLuint MLocation;
+//--model: multi-mesh .obj, its meshes are culled against the frustum through a BVH
+ogl::Model* model = nullptr;
+//With GL 4.3 the model is culled on the GPU (frustum and Hi-Z) and drawn with one call
+GPUDrivenRenderer* gpuDriven = nullptr;
+bool use_gpu_culling = true;
+
+//CPU copies of the meshes kept after their upload, --residency
+Residency meshResidency = RESIDENCY_KEEP;
+
+//Assets load in the background, their GL uploads take at most this per frame
+AsyncLoader* assetLoader = nullptr;
+const double ASSET_UPLOAD_BUDGET_MS = 2.0;
+//Meshes and textures by path, a file used twice is loaded once
+AssetRegistry* assets = nullptr;
+
+//The scene is drawn at a resolution that keeps its GPU time near the target, then upscaled
+DynamicResolution* dynamicResolution = nullptr;
+bool use_dynamic_resolution = false;
+float dynamic_resolution_ms = 8.0f;
+
+void uploadModelMaterial(const ogl::Material& mtl) {
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, mtl.texKd ? mtl.texKd : sceneTexture->name);
+}
+
+//Camera and light, bound once per frame for every program
+FrameUniformBuffer* frameUniforms;
 
 glm::vec4 background_color = glm::vec4(0.5f, 0.5f, 0.5f, 0.0f);
 
 
 #define g 9.80665f
 
-void renderTerrainScene() {
-	//Terrain Loading
-	mat4 projectionMatrix = camera->projectionMatrix;
-	mat4 viewMatrix = camera->viewMatrix;
+//Meshes far from the camera are drawn with fewer triangles, see common/simplify.h
+bool use_lod = true;
+float lod_threshold_pixels = 1.0f;
+int scene_lod = 0;
+
+LODSelector cameraLODSelector() {
+	float height = (float) (use_dynamic_resolution ? dynamicResolution->viewportHeight() : options.height);
+	return LODSelector(camera->position, radians(camera->FoV), height, lod_threshold_pixels);
+}
 
+//Per object data of the scene, uploaded when the queue executes its draw,
+//the camera comes from the FrameData block
+struct SceneDrawData {
+	mat4 M;
+	VertexQuantization quantization;
+} sceneDrawData;
+
+//Positions of quantized meshes are relative to their bounds
+VertexFormat vertexFormat = VERTEX_FLOAT;
+DequantizeUniforms sceneDequantize, particleDequantize, particleOITDequantize;
+
+void uploadSceneMatrices(void* user) {
+	SceneDrawData* data = (SceneDrawData*) user;
+	glUniformMatrix4fv(MLocation, 1, GL_FALSE, &data->M[0][0]);
+	sceneDequantize.upload(data->quantization);
+}
+
+//The emitter program changes with the particle mode
+struct EmitterDrawData {
+	const DequantizeUniforms* dequantize;
+	const VertexQuantization* quantization;
+} rainDrawData, cloudDrawData;
+
+void uploadEmitterQuantization(void* user) {
+	EmitterDrawData* data = (EmitterDrawData*) user;
+	data->dequantize->upload(*data->quantization);
+}
+
+void submitTerrainScene(RenderQueue& queue) {
+	//Terrain Loading
 	/*auto* scene = new Drawable("TerrainScenes/Small_Tropical_Island/Small_Tropical_Island.obj");
 
 	glActiveTexture(GL_TEXTURE0);
@@ -111,20 +233,26 @@ void renderTerrainScene() {
 
 	scene->draw();*/
 	
-	glUseProgram(normalShaderProgram);
-
-	glBindVertexArray(modelVAO);
-	mat4 modelModelMatrix = mat4(1);
-	mat4 modelMVP = projectionMatrix * viewMatrix * modelModelMatrix;
-	glUniformMatrix4fv(MVPLocation, 1, GL_FALSE, &modelMVP[0][0]);
-	glUniformMatrix4fv(MLocation, 1, GL_FALSE, &modelModelMatrix[0][0]);
-
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, sceneTexture);
-	glUniform1i(sceneSampler, 0);
-
-	glDrawArrays(GL_TRIANGLES, 0, modelVertices.size());
-
+	if (!scene->isUploaded()) return;
+
+	sceneDrawData.M = mat4(1);
+	sceneDrawData.quantization = scene->quantization;
+	scene_lod = use_lod ? scene->selectLOD(cameraLODSelector()) : 0;
+
+	DrawItem item = {};
+	item.program = normalShaderProgram;
+	item.vao = scene->VAO;
+	item.texture = sceneTexture->name;
+	item.samplerLocation = sceneSampler;
+	item.mode = GL_TRIANGLES;
+	item.count = scene->lods[scene_lod].indexCount;
+	item.first = scene->lods[scene_lod].firstIndex;
+	item.indexType = GL_UNSIGNED_INT;
+	item.setup = uploadSceneMatrices;
+	item.user = &sceneDrawData;
+	float depth = length(camera->position) / camera->farPlane;
+	item.key = RenderQueue::makeKey(RenderQueue::OPAQUE_LAYER, item.program, item.texture, item.vao, depth);
+	queue.submit(item);
 }
 
 //TO DO
@@ -150,6 +278,40 @@ void renderTerrainScene() {
 //	glDrawArrays(GL_TRIANGLES, 0, skyVertices.size());
 //}
 
+void recordFrameStats() {
+	frameStats.beginFrame();
+	frameStats.set("Frame CPU", profiler.lastFrameCpuTime());
+	frameStats.set("Frame GPU", profiler.lastFrameGpuTime());
+	for (int i = 0; i < profiler.cpuZoneCount(); i++) {
+		frameStats.set(profiler.cpuZoneName(i), profiler.cpuZoneTime(profiler.cpuZoneName(i)));
+	}
+	//GPU results arrive a few frames late, they are recorded with the latest frame
+	for (int i = 0; i < profiler.gpuZoneCount(); i++) {
+		frameStats.set(profiler.gpuZoneName(i), profiler.gpuZoneTime(profiler.gpuZoneName(i)));
+	}
+	frameStats.endFrame();
+}
+
+void renderFrameStats() {
+	//Percentiles show the hitches an averaged FPS hides
+	if (frameStats.seriesCount() > 0) {
+		FrameStats::Summary frame = frameStats.summarize(0);
+		ImGui::Text("Frame ms: median %.2f, p99 %.2f, max %.2f", frame.median, frame.p99, frame.max);
+	}
+	if (!ImGui::CollapsingHeader("Frame times")) return;
+
+	ImGui::Text("%-16s %7s %7s %7s %7s %7s", "ms", "min", "median", "p95", "p99", "max");
+	for (int i = 0; i < frameStats.seriesCount(); i++) {
+		FrameStats::Summary s = frameStats.summarize(i);
+		ImGui::Text("%-16s %7.2f %7.2f %7.2f %7.2f %7.2f", frameStats.seriesName(i), s.min, s.median, s.p95, s.p99, s.max);
+		ImGui::PlotLines(frameStats.seriesName(i), frameStats.samples(i), frameStats.sampleCount(),
+			frameStats.ringOffset(), NULL, 0.0f, s.max, ImVec2(0, 40));
+	}
+	if (ImGui::Button("Dump frame times to CSV")) {
+		frameStats.writeCSV("frametimes.csv");
+	}
+}
+
 void renderHelpingWindow() {
     static int counter = 0;
 
@@ -174,8 +336,54 @@ void renderHelpingWindow() {
 
     ImGui::Checkbox("Use sorting", &use_sorting);
     ImGui::Checkbox("Use rotations", &use_rotations);
+    const char* particle_modes[] = { "Forward", "Order independent", "Low resolution" };
+    ImGui::Combo("Particle blending", &particle_mode, particle_modes, 3);
+    if (particle_mode == PARTICLES_OIT && !oit->isSupported())
+        particle_mode = PARTICLES_FORWARD;
+    if (particle_mode == PARTICLES_LOW_RES) {
+        const char* factors[] = { "Full", "Half", "Quarter" };
+        ImGui::Combo("Particle resolution", &low_res_factor_item, factors, 3);
+        lowResParticles->setDownsampleFactor(1 << low_res_factor_item);
+    }
 
-    ImGui::Text("Performance %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+    if (assetLoader->pending() > 0) {
+        ImGui::Text("Loading assets, %d left", (int) assetLoader->pending());
+    }
+    ImGui::Text("Assets %d meshes, %d textures, %d loads shared", (int) assets->meshCount(),
+                (int) assets->textureCount(), assets->sharedRequests());
+    size_t hostBytes = assets->meshHostMemoryBytes() + (model ? model->hostMemoryBytes() : 0);
+    ImGui::Text("Mesh host memory %.2f MB", hostBytes / (1024.0 * 1024.0));
+    ImGui::Text("Awake emitters %d / %d", emitterManager.awakeEmitters(), emitterManager.totalEmitters());
+    if (gpuDriven) {
+        ImGui::Checkbox("GPU culling", &use_gpu_culling);
+    }
+    if (gpuDriven && use_gpu_culling) {
+        ImGui::Text("Model meshes %d, culled on the GPU", gpuDriven->meshCount());
+    }
+    else if (model) {
+        ImGui::Text("Model meshes drawn %d / %d in %d draws (%d materials)", model->lastDrawnMeshes(),
+                    model->meshCount(), model->lastDrawCalls(), (int) model->getMaterialGroups().size());
+    }
+    ImGui::Text("Draw calls %d, state calls %d (%d skipped)", renderQueue.drawCalls(), glState.issuedCalls, glState.skippedCalls);
+    ImGui::Checkbox("Mesh LOD", &use_lod);
+    if (use_lod) {
+        ImGui::SliderFloat("LOD error (pixels)", &lod_threshold_pixels, 0.25f, 8.0f);
+        if (scene->isUploaded()) ImGui::Text("Scene LOD %d / %d", scene_lod, (int) scene->lods.size() - 1);
+    }
+    ImGui::Checkbox("Dynamic resolution", &use_dynamic_resolution);
+    if (use_dynamic_resolution) {
+        ImGui::SliderFloat("Scene GPU target (ms)", &dynamic_resolution_ms, 1.0f, 33.0f);
+        ImGui::Text("Scene %dx%d (%.0f%%)", dynamicResolution->viewportWidth(), dynamicResolution->viewportHeight(),
+                    100.0f * dynamicResolution->getScale());
+    }
+    renderFrameStats();
+    if (trace_frames_left > 0) {
+        ImGui::Text("Capturing trace, %d frames left", trace_frames_left);
+    }
+    else if (ImGui::Button("Capture trace")) {
+        trace_frames_left = TRACE_FRAMES;
+        profiler.startCapture();
+    }
     ImGui::End();
  
     ImGui::Render();
@@ -184,10 +392,18 @@ void renderHelpingWindow() {
 }
 
 void createContext() {
+    //Meshes parse and images decode on workers, the scene draws what is there
+    assetLoader = new AsyncLoader();
+    assets = new AssetRegistry();
+
     particleShaderProgram = loadShaders(
         "ParticleShader.vertexshader",
         "ParticleShader.fragmentshader");
 
+    particleOITShaderProgram = loadShaders(
+        "ParticleShader.vertexshader",
+        "ParticleShaderOIT.fragmentshader");
+
     normalShaderProgram = loadShaders(
         "StandardShading.vertexshader",
         "StandardShading.fragmentshader");
@@ -197,16 +413,13 @@ void createContext() {
 		"TerrainShading.vertexshader",
 		"TerrainShading.fragmentshader");*/
 
-    projectionAndViewMatrix = glGetUniformLocation(particleShaderProgram, "PV");
-
-    translationMatrixLocation = glGetUniformLocation(normalShaderProgram, "T");
-    rotationMatrixLocation = glGetUniformLocation(normalShaderProgram, "R");
-    scaleMatrixLocation = glGetUniformLocation(normalShaderProgram, "S");
+    oitSamplerLocation = glGetUniformLocation(particleOITShaderProgram, "texture0");
 
-    modelMatrixLocation = glGetUniformLocation(normalShaderProgram, "M");
-
-    viewMatrixLocation = glGetUniformLocation(normalShaderProgram, "V");
-    projectionMatrixLocation = glGetUniformLocation(normalShaderProgram, "P");
+    //V, P and PV come from the per-frame uniform buffer
+    frameUniforms = new FrameUniformBuffer();
+    FrameUniformBuffer::bindBlock(particleShaderProgram);
+    FrameUniformBuffer::bindBlock(particleOITShaderProgram);
+    FrameUniformBuffer::bindBlock(normalShaderProgram);
 
 
 	// Draw wire frame triangles or fill: GL_LINE, or GL_FILL
@@ -214,66 +427,115 @@ void createContext() {
 
 	//// MODEL STUFF
 	// Get a pointer location to model matrix in the vertex shader
-	MVPLocation = glGetUniformLocation(normalShaderProgram, "MVP");
 	MLocation = glGetUniformLocation(normalShaderProgram, "M");
+	sceneDequantize = DequantizeUniforms::locate(normalShaderProgram);
+	particleDequantize = DequantizeUniforms::locate(particleShaderProgram);
+	particleOITDequantize = DequantizeUniforms::locate(particleOITShaderProgram);
 
 
 
     waterSampler = glGetUniformLocation(particleShaderProgram, "texture0");
 	//Attribution for water texture: <a href='https://www.freepik.com/photos/water'>Water photo created by rawpixel.com - www.freepik.com</a>
-	waterTexture = loadSOIL("blue.jpg");
+	waterTexture = assets->texture("blue.jpg", assetLoader);
 
 
 	cloudSampler = glGetUniformLocation(particleShaderProgram, "texture2");
-	cloudTexture = loadSOIL("cloud.jpg");
-
-
-	loadOBJWithTiny("TerrainScenes/Small_Tropical_Island/Small_Tropical_Island.obj", 
-		modelVertices, 
-		modelUVs, 
-		modelNormals);
-
-	glGenVertexArrays(1, &modelVAO);
-	glBindVertexArray(modelVAO);
-	glGenBuffers(1, &modelVerticiesVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, modelVerticiesVBO);
-	glBufferData(GL_ARRAY_BUFFER, modelVertices.size() * sizeof(glm::vec3),
-		&modelVertices[0], GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-	glEnableVertexAttribArray(0);
+	cloudTexture = assets->texture("cloud.jpg", assetLoader);
+
+
+	//Positions, normals and UVs, the ACMR before and after is logged
+	vertexFormat = options.quantize ? VERTEX_QUANTIZED : VERTEX_FLOAT;
+	meshResidency = options.residency == "drop" ? RESIDENCY_DROP_AFTER_UPLOAD :
+		options.residency == "collision" ? RESIDENCY_COLLISION_ONLY : RESIDENCY_KEEP;
+	scene = assets->mesh("TerrainScenes/Small_Tropical_Island/Small_Tropical_Island.obj", true, vertexFormat,
+		assetLoader, meshResidency);
+	if (!options.modelPath.empty()) {
+		model = new ogl::Model(options.modelPath, uploadModelMaterial, vertexFormat, assetLoader, assets,
+			meshResidency);
+	}
 	
-	sceneTexture = loadSOIL("TerrainScenes/Small_Tropical_Island/Maps/arl1b.jpg");
+	sceneTexture = assets->texture("TerrainScenes/Small_Tropical_Island/Maps/arl1b.jpg", assetLoader);
 	sceneSampler = glGetUniformLocation(normalShaderProgram, "texture1");
+
+	oit = new OITRenderer(options.width, options.height);
+	lowResParticles = new LowResParticlePass(options.width, options.height);
+	dynamicResolution = new DynamicResolution(options.width, options.height);
+	if (options.dynamicResolutionMs > 0.0f) {
+		use_dynamic_resolution = true;
+		dynamic_resolution_ms = options.dynamicResolutionMs;
+	}
 	
-    glfwSetKeyCallback(window, pollKeyboard);
+	if (window) {
+		glfwSetKeyCallback(window, pollKeyboard);
+	}
+
+	//Timed and replayed runs start with everything loaded, interactive ones at once
+	if (options.headless || !options.replayPath.empty()) {
+		assetLoader->finishAll();
+	}
 
 	
 }
 
 void free() {
 
-	glDeleteBuffers(1, &modelVerticiesVBO);
-	glDeleteVertexArrays(1, &modelVAO);
+	//Drops the loads still in flight, before the objects they write to
+	delete assetLoader;
+	assetLoader = nullptr;
+	scene = nullptr;
+	delete gpuDriven;
+	gpuDriven = nullptr;
+	delete model;
+	model = nullptr;
+	sceneTexture = waterTexture = cloudTexture = nullptr;
+	delete assets;
+	assets = nullptr;
+
+	delete oit;
+	oit = nullptr;
+	delete lowResParticles;
+	lowResParticles = nullptr;
+	delete dynamicResolution;
+	dynamicResolution = nullptr;
+	delete frameUniforms;
+	frameUniforms = nullptr;
+	profiler.release();
 
     glDeleteProgram(particleShaderProgram);
+    glDeleteProgram(particleOITShaderProgram);
 	glDeleteProgram(normalShaderProgram);
-    glfwTerminate();
+
+	if (offscreenTarget.framebuffer) {
+		deleteRenderTarget(offscreenTarget);
+	}
+	delete headlessContext;
+	headlessContext = nullptr;
+	delete replay;
+	replay = nullptr;
+	if (window) {
+		glfwTerminate();
+	}
 }
 
 void mainLoop() {
     
 	
 
-    IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
-    ImGuiIO& io = ImGui::GetIO(); (void)io;
-    ImGui::StyleColorsDark();
-    ImGui_ImplGlfw_InitForOpenGL(window, true);
-    ImGui_ImplOpenGL3_Init("#version 330");
+    if (!options.headless) {
+        IMGUI_CHECKVERSION();
+        ImGui::CreateContext();
+        ImGuiIO& io = ImGui::GetIO(); (void)io;
+        ImGui::StyleColorsDark();
+        ImGui_ImplGlfw_InitForOpenGL(window, true);
+        ImGui_ImplOpenGL3_Init("#version 330");
+    }
 
 	
 	
-	float t = glfwGetTime();
+	bool playing = replay && replay->isPlaying();
+	float t = playing ? 0.0f : elapsedSeconds();
+	double startTime = elapsedSeconds();
+	int frame = 0;
 	vec3 lightPos = vec3(10, 10, 10);
 
 	//TO DO - viewport of scene for the camera
@@ -281,58 +543,187 @@ void mainLoop() {
     camera->position = vec3(10, 10, 10);
 	
 	//Find a more realistic obj in future
-    auto* sphere = new Drawable("earth.obj");
-
-	FountainEmitter f_emitter = FountainEmitter(sphere, particles_slider);
+    //Both emitters draw the same mesh, loaded once
+    MeshHandle sphere = assets->mesh("earth.obj", true, vertexFormat, nullptr, meshResidency);
+
+#ifdef USE_POLICY_EMITTERS
+	PolicyFountainEmitter f_emitter(sphere.get(), particles_slider);
+	float& rain_height_threshold = f_emitter.kill.height_threshold;
+#else
+	FountainEmitter f_emitter = FountainEmitter(sphere.get(), particles_slider);
+	float& rain_height_threshold = f_emitter.height_threshold;
+#endif
+	f_emitter.emitter_pos = slider_emitter_pos;
+	rain_height_threshold = height_threshold;
+	//Recordings must call rand() the same number of times on every machine, so they are not time bounded
+	f_emitter.prewarm(4.0f, 1.0f / 30.0f, replay ? 0.0f : 50.0f);
 	
-	auto* cloud = new Drawable("earth.obj");
-	OrbitEmitter cloud_emitter = OrbitEmitter(cloud,10,5,6);
+	MeshHandle cloud = assets->mesh("earth.obj", true, vertexFormat, nullptr, meshResidency);
+#ifdef USE_POLICY_EMITTERS
+	PolicyOrbitEmitter cloud_emitter(cloud.get(), 10, OrbitSpawn(5, 6));
+#else
+	OrbitEmitter cloud_emitter = OrbitEmitter(cloud.get(),10,5,6);
+#endif
 	//FountainEmitter cloud_emitter = FountainEmitter(cloud, particles_slider);
+
+	emitterManager.addEmitter(&f_emitter, 50.0f);
+	emitterManager.addEmitter(&cloud_emitter, 6.0f);
 	
 
     
     do {
+		profiler.beginFrame();
+
+		//Playback sets the inputs, keys and camera pose of the recorded frame
+		float replayTime = 0.0f;
+		if (playing) {
+			replayTime = replay->playFrame(*camera, handleKey);
+		}
+
 		f_emitter.changeParticleNumber(particles_slider);
-		f_emitter.emitter_pos = slider_emitter_pos;
+		emitterManager.moveEmitter(&f_emitter, slider_emitter_pos);
 		f_emitter.use_rotations = use_rotations;
-		f_emitter.use_sorting = use_sorting;
-		f_emitter.height_threshold = height_threshold;
+		f_emitter.use_sorting = use_sorting && particle_mode != PARTICLES_OIT; //OIT does not depend on the draw order
+		rain_height_threshold = height_threshold;
 
-        float currentTime = glfwGetTime();
+        float currentTime = playing ? replayTime : elapsedSeconds();
         float dt = currentTime - t;
 
-        ImGui_ImplOpenGL3_NewFrame();
-        ImGui_ImplGlfw_NewFrame();
-        ImGui::NewFrame();
-        
+        if (!options.headless) {
+            ImGui_ImplOpenGL3_NewFrame();
+            ImGui_ImplGlfw_NewFrame();
+            ImGui::NewFrame();
+        }
+
+		{
+			PROFILE_CPU_SCOPE("Asset uploads");
+			assetLoader->pump(ASSET_UPLOAD_BUDGET_MS);
+			//The GPU-driven renderer draws from the buffers of the model, it starts once they are there
+			if (model && model->isLoaded() && !gpuDriven && GPUDrivenRenderer::isSupported()) {
+				gpuDriven = new GPUDrivenRenderer(*model, options.width, options.height);
+			}
+		}
+
+		//The scene and particle passes draw into the bottom-left corner of the dynamic resolution target
+		GLuint frameFramebuffer = sceneFramebuffer;
+		int viewWidth = options.width, viewHeight = options.height;
+		if (use_dynamic_resolution) {
+			dynamicResolution->setTargetFrameTime(dynamic_resolution_ms);
+			dynamicResolution->update(profiler.gpuZoneTime("Scene GPU") + profiler.gpuZoneTime("Particles GPU"));
+			frameFramebuffer = dynamicResolution->framebuffer();
+			viewWidth = dynamicResolution->viewportWidth();
+			viewHeight = dynamicResolution->viewportHeight();
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, frameFramebuffer);
+		glViewport(0, 0, viewWidth, viewHeight);
+		oit->setViewport(viewWidth, viewHeight);
+		lowResParticles->setViewport(viewWidth, viewHeight);
+		if (gpuDriven) {
+			gpuDriven->setViewport(viewWidth, viewHeight);
+		}
+
 		glClearColor(background_color[0], background_color[1], background_color[2], background_color[3]);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glUseProgram(particleShaderProgram);
-
         // camera
-        camera->update();
+        if (!playing) {
+            camera->update();
+        }
+        if (replay && !playing) {
+            replay->recordFrame(currentTime - startTime, *camera);
+        }
         mat4 projectionMatrix = camera->projectionMatrix;
         mat4 viewMatrix = camera->viewMatrix;
 
         auto PV = projectionMatrix * viewMatrix;
-        glUniformMatrix4fv(projectionAndViewMatrix, 1, GL_FALSE, &PV[0][0]);
+
+        FrameData frameData;
+        frameData.V = viewMatrix;
+        frameData.P = projectionMatrix;
+        frameData.PV = PV;
+        frameData.cameraPosition = vec4(camera->position, 1.0f);
+        frameData.lightPosition = vec4(lightPos, 1.0f);
+        frameData.lightColor = vec4(g_LightDiffuse[0], g_LightDiffuse[1], g_LightDiffuse[2], g_LightDiffuse[3]);
+        frameUniforms->update(frameData);
 
         //*/ Use particle based drawing
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, waterTexture);
-        glUniform1i(waterSampler, 0);
         if(!game_paused) {
-            f_emitter.updateParticles(currentTime, dt, camera->position);
-			cloud_emitter.updateParticles(currentTime, dt, camera->position);
+			PROFILE_CPU_SCOPE("Emitter update");
+			emitterManager.updateEmitters(currentTime, dt, camera->position, PV);
 		}
 
-		//Particles draw
-		f_emitter.renderParticles();
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, cloudTexture);
-		glUniform1i(cloudSampler, 0);
-		cloud_emitter.renderParticles();
+		//The OIT program writes the accumulation targets instead of blending
+		GLuint particleProgram = particleShaderProgram;
+		GLuint particleSamplerLocation = waterSampler;
+		if (particle_mode == PARTICLES_OIT) {
+			particleProgram = particleOITShaderProgram;
+			particleSamplerLocation = oitSamplerLocation;
+		}
+
+		{
+			PROFILE_CPU_SCOPE("Submit");
+			renderQueue.clear();
+			submitTerrainScene(renderQueue);
+			submitEmitter(renderQueue, f_emitter, rainDrawData, waterTexture->name, particleProgram, particleSamplerLocation);
+			submitEmitter(renderQueue, cloud_emitter, cloudDrawData, cloudTexture->name, particleProgram, particleSamplerLocation);
+			renderQueue.sort();
+		}
+
+		//Opaque scene first, the particle passes read its depth
+		glState.invalidate();
+		glState.resetCounters();
+		{
+			PROFILE_CPU_SCOPE("Scene draw");
+			PROFILE_GPU_SCOPE("Scene GPU");
+			renderQueue.execute(glState, RenderQueue::OPAQUE_LAYER);
+
+			if (model) {
+				glUseProgram(normalShaderProgram);
+				mat4 modelMatrix = mat4(1);
+				glUniformMatrix4fv(MLocation, 1, GL_FALSE, &modelMatrix[0][0]);
+				glUniform1i(sceneSampler, 0);
+				if (gpuDriven && use_gpu_culling) {
+					glActiveTexture(GL_TEXTURE0);
+					glBindTexture(GL_TEXTURE_2D, sceneTexture->name);
+					gpuDriven->draw(PV * modelMatrix);
+					//Next frame is occlusion tested against the depth of this one
+					gpuDriven->buildDepthPyramid(PV * modelMatrix, frameFramebuffer);
+				}
+				else {
+					LODSelector selector = cameraLODSelector();
+					model->draw(PV * modelMatrix, use_lod ? &selector : nullptr);
+				}
+				glState.invalidate(); //the model binds outside of the state cache
+			}
+		}
+
+		profiler.beginCpuZone("Particles draw");
+		profiler.beginGpuZone("Particles GPU");
+		if (particle_mode == PARTICLES_OIT) {
+			oit->beginAccumulation(frameFramebuffer);
+		}
+		else if (particle_mode == PARTICLES_LOW_RES) {
+			lowResParticles->begin(frameFramebuffer);
+			glState.invalidate(); //the depth downsample binds its own program and texture
+		}
+
+		renderQueue.execute(glState, RenderQueue::TRANSPARENT_LAYER);
+
+		if (particle_mode == PARTICLES_OIT) {
+			oit->composite(frameFramebuffer);
+		}
+		else if (particle_mode == PARTICLES_LOW_RES) {
+			lowResParticles->composite(camera->nearPlane, camera->farPlane, frameFramebuffer);
+		}
+		profiler.endGpuZone();
+		profiler.endCpuZone();
+
+		//The UI is drawn over the upscaled scene at the output resolution
+		if (use_dynamic_resolution) {
+			PROFILE_GPU_SCOPE("Upscale GPU");
+			dynamicResolution->upscale(sceneFramebuffer);
+			glState.invalidate();
+		}
 
 
 
@@ -380,35 +771,121 @@ void mainLoop() {
 
 		glDrawArrays(GL_TRIANGLES, 0, modelVertices.size());*/
 		
-		renderTerrainScene();
-		
 
 
-        renderHelpingWindow();
-        glfwPollEvents();
-        glfwSwapBuffers(window);
+        if (!options.headless) {
+            PROFILE_CPU_SCOPE("UI");
+            PROFILE_GPU_SCOPE("UI GPU");
+            renderHelpingWindow();
+        }
+        if (window) {
+            glfwPollEvents();
+            glfwSwapBuffers(window);
+        }
+        else {
+            glFlush(); //no swap to submit the frame
+        }
         t = currentTime;
+        frame++;
+
+        profiler.endFrame();
+        recordFrameStats();
+        if (trace_frames_left > 0 && --trace_frames_left == 0) {
+            profiler.stopCapture();
+            profiler.writeChromeTrace("trace.json");
+        }
 
-    } while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
-             glfwWindowShouldClose(window) == 0);
+    } while (keepRunning(frame));
+
+	if (options.headless) {
+		glFinish();
+		printTimingReport(frame, elapsedSeconds() - startTime);
+	}
+
+	//The emitters live on this stack frame
+	emitterManager.removeEmitter(&f_emitter);
+	emitterManager.removeEmitter(&cloud_emitter);
 
 	
 }
 
-void initialize() {
+bool keepRunning(int frame) {
+	if (replay && replay->isPlaying() && replay->finished()) return false;
+	if (options.headless) return (replay && replay->isPlaying()) || frame < options.frames;
+	return glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
+		glfwWindowShouldClose(window) == 0;
+}
+
+void startReplay() {
+	if (!options.replayPath.empty()) {
+		replay = new InputReplay(InputReplay::PLAY, options.replayPath);
+	}
+	else if (!options.recordPath.empty()) {
+		replay = new InputReplay(InputReplay::RECORD, options.recordPath, (unsigned int) time(NULL));
+	}
+	else {
+		return;
+	}
+
+	//Same seed, same respawns
+	srand(replay->getSeed());
+	replay->bind("particles", &particles_slider);
+	replay->bind("emitter_x", &slider_emitter_pos.x);
+	replay->bind("emitter_y", &slider_emitter_pos.y);
+	replay->bind("emitter_z", &slider_emitter_pos.z);
+	replay->bind("height_threshold", &height_threshold);
+	replay->bind("paused", &game_paused);
+	replay->bind("sorting", &use_sorting);
+	replay->bind("rotations", &use_rotations);
+	replay->bind("particle_mode", &particle_mode);
+	replay->bind("low_res_factor", &low_res_factor_item);
+	replay->bind("dynamic_resolution", &use_dynamic_resolution);
+	replay->bind("dynamic_resolution_ms", &dynamic_resolution_ms);
+}
+
+void printTimingReport(int frames, double seconds) {
+	cout << "Rendered " << frames << " frames at " << options.width << "x" << options.height
+		<< " in " << seconds << " s (" << frames / seconds << " FPS)" << endl;
+	cout << "Last " << frameStats.sampleCount() << " frames, ms: min / median / p95 / p99 / max" << endl;
+	for (int i = 0; i < frameStats.seriesCount(); i++) {
+		FrameStats::Summary s = frameStats.summarize(i);
+		printf("  %-16s %8.3f %8.3f %8.3f %8.3f %8.3f\n", frameStats.seriesName(i), s.min, s.median, s.p95, s.p99, s.max);
+	}
+	if (!options.csvPath.empty()) {
+		frameStats.writeCSV(options.csvPath);
+	}
+}
+
+void initializeHeadless() {
+	//The GPU-driven path of the model uses compute shaders
+	headlessContext = new HeadlessContext(!options.modelPath.empty());
+
+	//The offscreen target replaces the default framebuffer for every pass
+	offscreenTarget = createRenderTarget(options.width, options.height);
+	sceneFramebuffer = offscreenTarget.framebuffer;
+	glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+	glViewport(0, 0, options.width, options.height);
+}
+
+void initializeWindow() {
     // Initialize GLFW
     if (!glfwInit()) {
         throw runtime_error("Failed to initialize GLFW\n");
     }
 
     glfwWindowHint(GLFW_SAMPLES, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // To make MacOS happy
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-    // Open a window and create its OpenGL context
-    window = glfwCreateWindow(W_WIDTH, W_HEIGHT, TITLE, NULL, NULL);
+    // Open a window and create its OpenGL context. The GPU-driven path of the model
+    // uses compute shaders, so 4.3 is asked for first when there is one, then 3.3
+    const int majorVersions[] = {4, 3};
+    window = NULL;
+    for (int i = options.modelPath.empty() ? 1 : 0; i < 2 && window == NULL; i++) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, majorVersions[i]);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(options.width, options.height, TITLE, NULL, NULL);
+    }
     if (window == NULL) {
         glfwTerminate();
         throw runtime_error(string(string("Failed to open GLFW window.") +
@@ -435,7 +912,21 @@ void initialize() {
 
     // Set the mouse at the center of the screen
     glfwPollEvents();
-    glfwSetCursorPos(window, W_WIDTH / 2, W_HEIGHT / 2);
+    glfwSetCursorPos(window, options.width / 2, options.height / 2);
+
+    glfwSetCursorPosCallback(window, [](GLFWwindow* window, double xpos, double ypos) {
+                                 camera->onMouseMove(xpos, ypos);
+                             }
+    );
+}
+
+void initialize() {
+    if (options.headless) {
+        initializeHeadless();
+    }
+    else {
+        initializeWindow();
+    }
 
     // Gray background color
     glClearColor(0.5f, 0.5f, 0.5f, 0.0f);
@@ -481,11 +972,7 @@ void initialize() {
 
     // Create camera
     camera = new Camera(window);
-
-    glfwSetCursorPosCallback(window, [](GLFWwindow* window, double xpos, double ypos) {
-                                 camera->onMouseMove(xpos, ypos);
-                             }
-    );
+    camera->aspectRatio = (float) options.width / options.height;
 
 	
 	
@@ -493,6 +980,13 @@ void initialize() {
 }
 
 void pollKeyboard(GLFWwindow* window, int key, int scancode, int action, int mods) {
+	//During playback the keys come from the recording
+	if (replay && replay->isPlaying()) return;
+	if (replay) replay->keyEvent(key, action);
+	handleKey(key, action);
+}
+
+void handleKey(int key, int action) {
 	// Pause
 	if (key == GLFW_KEY_P && action == GLFW_PRESS) {
 		game_paused = !game_paused;
@@ -537,7 +1031,7 @@ void pollKeyboard(GLFWwindow* window, int key, int scancode, int action, int mod
 	}
 
 
-	if (key == GLFW_KEY_GRAVE_ACCENT && action == GLFW_PRESS) {
+	if (window && key == GLFW_KEY_GRAVE_ACCENT && action == GLFW_PRESS) {
 		if (glfwGetInputMode(window, GLFW_CURSOR) == GLFW_CURSOR_NORMAL) {
 			glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 			camera->active = true;
@@ -550,8 +1044,14 @@ void pollKeyboard(GLFWwindow* window, int key, int scancode, int action, int mod
 	}
 }
 
-int main(void) {
+int main(int argc, char** argv) {
     try {
+        options = parseRunOptions(argc, argv);
+        if (!options.benchObjPath.empty()) {
+            benchmarkOBJLoaders(options.benchObjPath);
+            return 0;
+        }
+        startReplay();
         initialize();
         createContext();
 
@@ -561,7 +1061,7 @@ int main(void) {
         free();
     } catch (exception& ex) {
         cout << ex.what() << endl;
-        getchar();
+        if (!options.headless) getchar();
         free();
         return -1;
     }
@@ -570,6 +1070,30 @@ int main(void) {
 }
 
 
+void submitEmitter(RenderQueue& queue, IntParticleEmitter& emitter, EmitterDrawData& drawData, GLuint texture, GLuint program, GLuint samplerLocation) {
+	if (!emitterManager.isAwake(&emitter) || emitter.number_of_particles == 0) return;
+
+	//PV comes from the FrameData block, only the instance buffers are per emitter
+	emitter.updateBuffers();
+
+	DrawItem item = {};
+	item.program = program;
+	item.vao = emitter.emitterVAO;
+	item.texture = texture;
+	item.samplerLocation = samplerLocation;
+	item.mode = GL_TRIANGLES;
+	item.count = emitter.indexCount();
+	item.indexType = GL_UNSIGNED_INT;
+	item.instances = emitter.number_of_particles;
+	drawData.dequantize = program == particleOITShaderProgram ? &particleOITDequantize : &particleDequantize;
+	drawData.quantization = &emitter.quantization();
+	item.setup = uploadEmitterQuantization;
+	item.user = &drawData;
+	float depth = length(emitter.emitter_pos - camera->position) / camera->farPlane;
+	item.key = RenderQueue::makeKey(RenderQueue::TRANSPARENT_LAYER, program, texture, item.vao, depth);
+	queue.submit(item);
+}
+
 void windXManipulation() {
 	particle.factorXWind += particle.factorXWind * 5.1f;
 
@@ -1,12 +1,28 @@
 #include "model.h"
 #include <iostream>
-#include <sstream>
-#include <map>
+#include <cstdint>
+#include <climits>
+#include <cmath>
+#include <charconv>
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <tinyxml2.h>
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 #include "common/util.h"
+#include "common/meshopt.h"
+#include "common/frustum.h"
+#include "common/parallel.h"
+#include "common/meshcache.h"
+#include "common/mappedfile.h"
+#include "common/asyncloader.h"
+#include "common/vtkdata.h"
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
+#include <numeric>
 #include "texture.h"
+#include "AssetRegistry.h"
 
 using namespace glm;
 using namespace std;
@@ -112,116 +128,68 @@ void loadVTP(
         vector<vec3>& normals,
         vector<unsigned int>& indices) {
     indices.clear();
-    const char* method = "PolygonalMesh::loadVtpFile()";
-    XMLDocument vtp;
-    auto res = vtp.LoadFile(path.c_str());
-    assert(res == 0);
-
-    XMLElement* root = vtp.FirstChildElement("VTKFile");
-    assert(root != nullptr);
-    assert(root->Attribute("type", "PolyData"));
-
-    XMLElement* polydata = root->FirstChildElement("PolyData");
-    assert(polydata != nullptr);
-    XMLElement* piece = polydata->FirstChildElement("Piece");
-    assert(piece != nullptr);
-    XMLElement* enormals = piece->FirstChildElement("PointData");
-    assert(enormals != nullptr);
-    XMLElement* points = piece->FirstChildElement("Points");
-    assert(points != nullptr);
-
-    int numPoints, numPolys;
+    VTKDataReader vtp(path);
+    const XMLElement* root = vtp.root();
+    const char* type = root->Attribute("type");
+    if (!type || strcmp(type, "PolyData") != 0) throw runtime_error(path + ": not a PolyData file");
+    const XMLElement* polydata = root->FirstChildElement("PolyData");
+    const XMLElement* piece = polydata ? polydata->FirstChildElement("Piece") : nullptr;
+    if (!piece) throw runtime_error(path + ": no Piece");
+
+    int numPoints = 0, numPolys = 0;
     piece->QueryIntAttribute("NumberOfPoints", &numPoints);
     piece->QueryIntAttribute("NumberOfPolys", &numPolys);
 
-    //assert(enormals->Attribute("format", "ascii"));
-    const char* normalsStr = enormals->FirstChildElement("DataArray")->FirstChild()->Value();
-    stringstream sNorm(normalsStr);
-    vector<vec3> tempNormals;
-    do {
-        vec3 normal;
-        sNorm >> normal.x >> normal.y >> normal.z;
-        tempNormals.push_back(normal);
-    } while (sNorm.good());
-    assert(tempNormals.size() == numPoints + 1);
-
-    XMLElement* pointData = points->FirstChildElement("DataArray");
-    assert(pointData != nullptr);
-    assert(pointData->Attribute("format", "ascii"));
-    const char* coordsStr = points->FirstChildElement("DataArray")->FirstChild()->Value();
-
-    stringstream sCoord(coordsStr);
-    vector<vec3> coordinates;
-    do {
-        vec3 coord;
-        sCoord >> coord.x >> coord.y >> coord.z;
-        coordinates.push_back(coord);
-    } while (sCoord.good());
-    coordinates.pop_back();  // the last is corrupted
-    assert(coordinates.size() == numPoints);
-
-    XMLElement* polys = piece->FirstChildElement("Polys");
-    assert(polys != nullptr);
-
-    // TODO beter implementation
-    XMLElement *econnectivity, *eoffsets;
-    if (polys->FirstChildElement("DataArray")->Attribute("Name", "connectivity")) {
-        econnectivity = polys->FirstChildElement("DataArray");
-        assert(econnectivity != nullptr);
-        assert(econnectivity->Attribute("format", "ascii"));
-    } else {
-        throw runtime_error("Can't access connectivity");
+    const XMLElement* points = piece->FirstChildElement("Points");
+    vector<float> coordinates = vtp.readFloats(points ? points->FirstChildElement("DataArray") : nullptr);
+    if (coordinates.size() != 3 * (size_t) numPoints) throw runtime_error(path + ": wrong number of points");
+
+    // the array PointData names as its normals, or its first vector
+    vector<float> pointNormals;
+    if (const XMLElement* pointData = piece->FirstChildElement("PointData")) {
+        const XMLElement* array = VTKDataReader::findArray(pointData, pointData->Attribute("Normals"));
+        if (array) pointNormals = vtp.readFloats(array);
+        if (!pointNormals.empty() && pointNormals.size() != coordinates.size()) {
+            throw runtime_error(path + ": wrong number of normals");
+        }
     }
 
-    if (polys->LastChildElement("DataArray")->Attribute("Name", "offsets")) {
-        eoffsets = polys->LastChildElement("DataArray");
-        assert(eoffsets != nullptr);
-        assert(eoffsets->Attribute("format", "ascii"));
-    } else {
-        throw runtime_error("Can't access offsets");
-    }
-
-    // read offsets
-    const char* offsetsStr = eoffsets->FirstChild()->Value();
-    stringstream sOffsets(offsetsStr);
-    vector<int> offsets;
-    do {
-        int offset;
-        sOffsets >> offset;
-        offsets.push_back(offset);
-    } while (sOffsets.good());
-    assert(offsets.size() == numPolys + 1);
-
-    // read connectivity
-    const char* connStr = econnectivity->FirstChild()->Value();
-    stringstream sConn(connStr);
-    vector<int> connectivity;
-    do {
-        int conn;
-        sConn >> conn;
-        connectivity.push_back(conn);
-    } while (sConn.good());
-    assert(connectivity.size() == offsets.back() + 1);
-
-    // construct vertices
-    int startPoly = 0;
-    for (int i = 0; i < numPolys; ++i) {
-        vector<int> face = slice(connectivity, startPoly, offsets[i]);
-        int i1 = 0, i2 = 1, i3 = 2;
-        while (i3 != face.size()) {
-            vertices.push_back(coordinates[face[i1]]);
-            normals.push_back(tempNormals[face[i1]]);
-            indices.push_back(indices.size());
-            vertices.push_back(coordinates[face[i2]]);
-            normals.push_back(tempNormals[face[i2]]);
-            indices.push_back(indices.size());
-            vertices.push_back(coordinates[face[i3]]);
-            normals.push_back(tempNormals[face[i3]]);
-            indices.push_back(indices.size());
-            i2++;
-            i3++;
+    const XMLElement* polys = piece->FirstChildElement("Polys");
+    if (!polys) throw runtime_error(path + ": no Polys");
+    vector<int64_t> connectivity = vtp.readIntegers(VTKDataReader::findArray(polys, "connectivity"));
+    vector<int64_t> offsets = vtp.readIntegers(VTKDataReader::findArray(polys, "offsets"));
+    if (offsets.size() != (size_t) numPolys || (numPolys > 0 && offsets.back() != (int64_t) connectivity.size())) {
+        throw runtime_error(path + ": offsets don't match the connectivity");
+    }
+    for (int64_t point : connectivity) {
+        if (point < 0 || point >= numPoints) throw runtime_error(path + ": point index out of range");
+    }
+
+    // triangle fans of the polygons, not indexed
+    size_t triangles = 0;
+    int64_t start = 0;
+    for (int64_t end : offsets) {
+        if (end < start) throw runtime_error(path + ": decreasing offsets");
+        if (end - start > 2) triangles += end - start - 2;
+        start = end;
+    }
+    vertices.reserve(vertices.size() + 3 * triangles);
+    if (!pointNormals.empty()) normals.reserve(normals.size() + 3 * triangles);
+    auto addCorner = [&](int64_t point) {
+        vertices.push_back(vec3(coordinates[3 * point], coordinates[3 * point + 1], coordinates[3 * point + 2]));
+        if (!pointNormals.empty()) {
+            normals.push_back(vec3(pointNormals[3 * point], pointNormals[3 * point + 1], pointNormals[3 * point + 2]));
+        }
+        indices.push_back((unsigned int) indices.size());
+    };
+    start = 0;
+    for (int64_t end : offsets) {
+        for (int64_t corner = start + 2; corner < end; corner++) {
+            addCorner(connectivity[start]);
+            addCorner(connectivity[corner - 1]);
+            addCorner(connectivity[corner]);
         }
-        startPoly = offsets[i];
+        start = end;
     }
 }
 
@@ -268,28 +236,330 @@ void loadOBJWithTiny(
     // TODO .mtl loader
 }
 
-struct PackedVertex {
-    glm::vec3 position;
-    glm::vec2 uv;
-    glm::vec3 normal;
-    bool operator<(const PackedVertex that) const {
-        return memcmp((void*) this, (void*) &that, sizeof(PackedVertex)) > 0;
-    };
+/*****************************************************************************/
+
+enum ObjLineType { OBJ_OTHER, OBJ_POSITION, OBJ_TEXCOORD, OBJ_NORMAL, OBJ_FACE };
+
+// 0 based indices of a face corner, -1 when the attribute is missing
+struct ObjCorner {
+    int position, texcoord, normal;
 };
 
-bool getSimilarVertexIndex(
-        PackedVertex& packed,
-        map<PackedVertex, unsigned int>& vertexToOutIndex,
-        unsigned int& result) {
-    map<PackedVertex, unsigned int>::iterator it = vertexToOutIndex.find(packed);
-    if (it == vertexToOutIndex.end()) {
-        return false;
-    } else {
-        result = it->second;
-        return true;
+struct ObjCounts {
+    size_t positions, texcoords, normals, corners;
+};
+
+static bool isObjSpace(char c) {
+    return c == ' ' || c == '\t';
+}
+
+static const char* skipObjSpaces(const char* p, const char* end) {
+    while (p < end && isObjSpace(*p)) p++;
+    return p;
+}
+
+static const char* skipObjToken(const char* p, const char* end) {
+    while (p < end && !isObjSpace(*p)) p++;
+    return p;
+}
+
+// Call f(line, lineEnd) for every line of [p, end), without the end of line
+template<typename F>
+static void forEachObjLine(const char* p, const char* end, F f) {
+    while (p < end) {
+        const char* newline = (const char*) memchr(p, '\n', end - p);
+        const char* lineEnd = newline ? newline : end;
+        f(p, lineEnd > p && lineEnd[-1] == '\r' ? lineEnd - 1 : lineEnd);
+        p = lineEnd + 1;
+    }
+}
+
+// Moves p past the keyword, the keywords are those of tinyobjloader
+static ObjLineType objLineType(const char*& p, const char* end) {
+    p = skipObjSpaces(p, end);
+    if (end - p >= 2 && p[0] == 'v' && isObjSpace(p[1])) {
+        p += 2;
+        return OBJ_POSITION;
+    }
+    if (end - p >= 3 && p[0] == 'v' && (p[1] == 't' || p[1] == 'n') && isObjSpace(p[2])) {
+        p += 3;
+        return p[-2] == 't' ? OBJ_TEXCOORD : OBJ_NORMAL;
+    }
+    if (end - p >= 2 && p[0] == 'f' && isObjSpace(p[1])) {
+        p += 2;
+        return OBJ_FACE;
+    }
+    return OBJ_OTHER;
+}
+
+// Parsed through a double and rounded to float like tinyobjloader,
+// a malformed value reads as 0
+static float parseObjReal(const char*& p, const char* end) {
+    p = skipObjSpaces(p, end);
+    const char* tokenEnd = skipObjToken(p, end);
+    const char* first = p < tokenEnd && *p == '+' ? p + 1 : p;
+    double value = 0.0;
+    if (from_chars(first, tokenEnd, value).ec != errc()) value = 0.0;
+    p = tokenEnd;
+    return (float) value;
+}
+
+// OBJ indices are 1 based, negative ones count back from the last attribute.
+// 0 and negative ones reaching before the first attribute are malformed, they
+// map out of range so the corner is rejected, unlike a missing attribute (-1)
+static int fixObjIndex(int index, size_t count) {
+    if (index > 0) return index - 1;
+    if (index < 0 && (size_t) -(long long) index <= count) return (int) count + index;
+    return INT_MAX;
+}
+
+// v, v/vt, v//vn or v/vt/vn
+static ObjCorner parseObjCorner(const char* p, const char* tokenEnd, const ObjCounts& counts) {
+    ObjCorner corner = {-1, -1, -1};
+    int value;
+    auto parsed = from_chars(p, tokenEnd, value);
+    if (parsed.ec == errc()) corner.position = fixObjIndex(value, counts.positions);
+    p = parsed.ptr;
+    if (p == tokenEnd || *p++ != '/') return corner;
+    parsed = from_chars(p, tokenEnd, value);
+    if (parsed.ec == errc()) corner.texcoord = fixObjIndex(value, counts.texcoords);
+    p = parsed.ptr;
+    if (p == tokenEnd || *p++ != '/') return corner;
+    if (from_chars(p, tokenEnd, value).ec == errc()) corner.normal = fixObjIndex(value, counts.normals);
+    return corner;
+}
+
+static size_t countObjFaceCorners(const char* p, const char* end) {
+    size_t vertices = 0;
+    while ((p = skipObjSpaces(p, end)) < end) {
+        p = skipObjToken(p, end);
+        vertices++;
+    }
+    // triangle fan
+    return vertices >= 3 ? 3 * (vertices - 2) : 0;
+}
+
+void loadOBJFast(
+        const string& path,
+        vector<vec3>& vertices,
+        vector<vec2>& uvs,
+        vector<vec3>& normals,
+        vector<unsigned int>& indices) {
+    MappedFile file(path);
+    const char* begin = (const char*) file.data();
+    const char* end = begin + file.size();
+
+    // chunk boundaries are moved to the start of the next line
+    size_t chunks = parallelChunks(file.size(), 1 << 20);
+    vector<const char*> bounds(chunks + 1, end);
+    bounds[0] = begin;
+    for (size_t chunk = 1; chunk < chunks; chunk++) {
+        const char* p = std::max(begin + file.size() * chunk / chunks, bounds[chunk - 1]);
+        const char* newline = p < end ? (const char*) memchr(p, '\n', end - p) : nullptr;
+        bounds[chunk] = newline ? newline + 1 : end;
+    }
+
+    // count the attributes and corners of every chunk, their prefix sums
+    // are where each chunk writes, so negative indices can be resolved
+    vector<ObjCounts> counts(chunks + 1, ObjCounts{0, 0, 0, 0});
+    parallelFor(chunks, chunks, [&](size_t, size_t first, size_t last) {
+        for (size_t chunk = first; chunk < last; chunk++) {
+            ObjCounts& count = counts[chunk + 1];
+            forEachObjLine(bounds[chunk], bounds[chunk + 1], [&](const char* p, const char* lineEnd) {
+                switch (objLineType(p, lineEnd)) {
+                    case OBJ_POSITION: count.positions++; break;
+                    case OBJ_TEXCOORD: count.texcoords++; break;
+                    case OBJ_NORMAL: count.normals++; break;
+                    case OBJ_FACE: count.corners += countObjFaceCorners(p, lineEnd); break;
+                    default: break;
+                }
+            });
+        }
+    });
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+        counts[chunk + 1].positions += counts[chunk].positions;
+        counts[chunk + 1].texcoords += counts[chunk].texcoords;
+        counts[chunk + 1].normals += counts[chunk].normals;
+        counts[chunk + 1].corners += counts[chunk].corners;
+    }
+
+    const ObjCounts& total = counts[chunks];
+    vector<vec3> positions(total.positions), objNormals(total.normals);
+    vector<vec2> texcoords(total.texcoords);
+    vector<ObjCorner> corners(total.corners);
+    parallelFor(chunks, chunks, [&](size_t, size_t first, size_t last) {
+        for (size_t chunk = first; chunk < last; chunk++) {
+            ObjCounts next = counts[chunk];
+            forEachObjLine(bounds[chunk], bounds[chunk + 1], [&](const char* p, const char* lineEnd) {
+                switch (objLineType(p, lineEnd)) {
+                    case OBJ_POSITION: {
+                        vec3& position = positions[next.positions++];
+                        position.x = parseObjReal(p, lineEnd);
+                        position.y = parseObjReal(p, lineEnd);
+                        position.z = parseObjReal(p, lineEnd);
+                        break;
+                    }
+                    case OBJ_TEXCOORD: {
+                        vec2& texcoord = texcoords[next.texcoords++];
+                        texcoord.x = parseObjReal(p, lineEnd);
+                        texcoord.y = parseObjReal(p, lineEnd);
+                        break;
+                    }
+                    case OBJ_NORMAL: {
+                        vec3& normal = objNormals[next.normals++];
+                        normal.x = parseObjReal(p, lineEnd);
+                        normal.y = parseObjReal(p, lineEnd);
+                        normal.z = parseObjReal(p, lineEnd);
+                        break;
+                    }
+                    case OBJ_FACE: {
+                        ObjCorner first = {}, previous = {};
+                        int vertex = 0;
+                        while ((p = skipObjSpaces(p, lineEnd)) < lineEnd) {
+                            const char* tokenEnd = skipObjToken(p, lineEnd);
+                            ObjCorner corner = parseObjCorner(p, tokenEnd, next);
+                            p = tokenEnd;
+                            if (vertex >= 2) {
+                                corners[next.corners++] = first;
+                                corners[next.corners++] = previous;
+                                corners[next.corners++] = corner;
+                            }
+                            if (vertex == 0) first = corner;
+                            previous = corner;
+                            vertex++;
+                        }
+                        break;
+                    }
+                    default:
+                        break;
+                }
+            });
+        }
+    });
+
+    // expand the corners like loadOBJWithTiny
+    size_t vertexBase = vertices.size(), uvBase = uvs.size(), normalBase = normals.size();
+    size_t indexBase = indices.size();
+    vertices.resize(vertexBase + corners.size());
+    if (!texcoords.empty()) uvs.resize(uvBase + corners.size());
+    if (!objNormals.empty()) normals.resize(normalBase + corners.size());
+    indices.resize(indexBase + corners.size());
+    atomic<bool> invalid(false);
+    parallelFor(corners.size(), parallelChunks(corners.size(), 1 << 16), [&](size_t, size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            const ObjCorner& corner = corners[i];
+            if (corner.position < 0 || corner.position >= (int) positions.size() ||
+                corner.texcoord >= (int) texcoords.size() || corner.normal >= (int) objNormals.size()) {
+                invalid = true;
+                continue;
+            }
+            vertices[vertexBase + i] = positions[corner.position];
+            if (!texcoords.empty()) {
+                vec2 uv = corner.texcoord >= 0 ? texcoords[corner.texcoord] : vec2(0.0f);
+                uvs[uvBase + i] = vec2(uv.x, 1 - uv.y);
+            }
+            if (!objNormals.empty()) {
+                normals[normalBase + i] = corner.normal >= 0 ? objNormals[corner.normal] : vec3(0.0f);
+            }
+            indices[indexBase + i] = (unsigned int) (indexBase + i);
+        }
+    });
+    if (invalid) {
+        throw runtime_error("Invalid face index in " + path);
     }
 }
 
+void benchmarkOBJLoaders(const string& path, int runs) {
+    uint64_t size;
+    int64_t mtime;
+    if (!fileStatus(path, size, mtime)) {
+        throw runtime_error("Can't open " + path);
+    }
+    double megabytes = size / (1024.0 * 1024.0);
+
+    typedef void (*Loader)(const string&, vector<vec3>&, vector<vec2>&, vector<vec3>&, vector<unsigned int>&);
+    const char* names[] = {"loadOBJ", "loadOBJWithTiny", "loadOBJFast"};
+    Loader loaders[] = {loadOBJ, loadOBJWithTiny, loadOBJFast};
+    vector<vec3> vertices[3], normals[3];
+    vector<vec2> uvs[3];
+    vector<unsigned int> indices[3];
+    for (int l = 0; l < 3; l++) {
+        double best = 0.0;
+        try {
+            for (int run = 0; run < runs; run++) {
+                vertices[l].clear();
+                uvs[l].clear();
+                normals[l].clear();
+                indices[l].clear();
+                auto start = chrono::steady_clock::now();
+                loaders[l](path, vertices[l], uvs[l], normals[l], indices[l]);
+                double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                best = run == 0 ? seconds : std::min(best, seconds);
+            }
+        } catch (const exception& e) {
+            cout << names[l] << ": " << e.what() << endl;
+            continue;
+        }
+        cout << names[l] << ": " << best * 1000.0 << " ms, " << megabytes / best << " MB/s, "
+             << vertices[l].size() << " vertices" << endl;
+    }
+
+    bool identical = vertices[1] == vertices[2] && uvs[1] == uvs[2] &&
+                     normals[1] == normals[2] && indices[1] == indices[2];
+    cout << "loadOBJFast " << (identical ? "matches" : "DIFFERS from") << " loadOBJWithTiny" << endl;
+}
+
+// Vertices are compared through the bits of their attributes, or of the
+// attributes snapped to a grid of weldEpsilon when welding
+struct VertexKey {
+    uint32_t bits[8];
+    bool operator==(const VertexKey& that) const {
+        return memcmp(bits, that.bits, sizeof(bits)) == 0;
+    }
+};
+
+static uint32_t snapComponent(float value, float inverseEpsilon) {
+    if (inverseEpsilon == 0.0f) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+    return (uint32_t) (int32_t) llround(value * inverseEpsilon);
+}
+
+static VertexKey vertexKey(
+        const vector<vec3>& vertices, const vector<vec2>& uvs, const vector<vec3>& normals,
+        size_t i, float inverseEpsilon) {
+    float values[8] = {vertices[i].x, vertices[i].y, vertices[i].z};
+    if (uvs.size() != 0) {
+        values[3] = uvs[i].x;
+        values[4] = uvs[i].y;
+    }
+    if (normals.size() != 0) {
+        values[5] = normals[i].x;
+        values[6] = normals[i].y;
+        values[7] = normals[i].z;
+    }
+    VertexKey key;
+    for (int c = 0; c < 8; c++) key.bits[c] = snapComponent(values[c], inverseEpsilon);
+    return key;
+}
+
+// a vertex in the list of its shard
+struct ShardEntry {
+    VertexKey key;
+    uint32_t index, hash;
+};
+
+static uint32_t hashKey(const VertexKey& key) {
+    uint64_t h = 0x9E3779B97F4A7C15ull;
+    for (uint32_t bits : key.bits) {
+        h = (h ^ bits) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+    }
+    return (uint32_t) h;
+}
+
 void indexVBO(
         const vector<vec3>& in_vertices,
         const vector<vec2>& in_uvs,
@@ -297,58 +567,275 @@ void indexVBO(
         vector<unsigned int>& out_indices,
         vector<vec3>& out_vertices,
         vector<vec2>& out_uvs,
-        vector<vec3>& out_normals) {
-    map<PackedVertex, unsigned int> vertexToOutIndex;
-
-    // For each input vertex
-    for (int i = 0; i < static_cast<int>(in_vertices.size()); i++) {
-        vec3 vertices = in_vertices[i];
-        vec2 uvs;
-        vec3 normals;
-        if (in_uvs.size() != 0) uvs = in_uvs[i];
-        if (in_normals.size() != 0) normals = in_normals[i];
-        PackedVertex packed = {vertices, uvs, normals};
-
-        // Try to find a similar vertex in out_XXXX
-        unsigned int index;
-        bool found = getSimilarVertexIndex(packed, vertexToOutIndex, index);
-
-        if (found) { // A similar vertex is already in the VBO, use it instead !
-            out_indices.push_back(index);
-        } else { // If not, it needs to be added in the output data.
-            out_vertices.push_back(vertices);
-            if (in_uvs.size() != 0) out_uvs.push_back(uvs);
-            if (in_normals.size() != 0) out_normals.push_back(normals);
-            unsigned int newindex = (unsigned int) out_vertices.size() - 1;
-            out_indices.push_back(newindex);
-            vertexToOutIndex[packed] = newindex;
+        vector<vec3>& out_normals,
+        float weldEpsilon) {
+    const uint32_t EMPTY = 0xFFFFFFFFu;
+    size_t n = in_vertices.size();
+    float inverseEpsilon = weldEpsilon > 0.0f ? 1.0f / weldEpsilon : 0.0f;
+    auto key = [&](size_t i) { return vertexKey(in_vertices, in_uvs, in_normals, i, inverseEpsilon); };
+
+    // the vertices are split in chunks, one per thread, and the hashes in
+    // shards small enough for their table to stay in the cache. The high
+    // bits pick the shard and the low bits the slot in its table
+    size_t chunks = parallelChunks(n, 1 << 14);
+    size_t shards = std::max(chunks, std::min<size_t>(n / (1 << 14), 1 << 15));
+    auto shardOf = [&](uint32_t hash) { return (size_t) (((uint64_t) (hash >> 16) * shards) >> 16); };
+
+    // hash every vertex once and count the vertices of each chunk per shard
+    vector<uint32_t> hashes(n);
+    vector<size_t> counts(chunks * shards, 0);
+    parallelFor(n, chunks, [&](size_t chunk, size_t begin, size_t end) {
+        size_t* count = &counts[chunk * shards];
+        for (size_t i = begin; i < end; i++) {
+            hashes[i] = hashKey(key(i));
+            count[shardOf(hashes[i])]++;
+        }
+    });
+
+    // copy the keys grouped by shard, shard major and chunk minor so every
+    // shard lists its vertices in increasing order and is read sequentially
+    vector<size_t> offsets(chunks * shards), shardBegin(shards + 1);
+    size_t offset = 0;
+    for (size_t shard = 0; shard < shards; shard++) {
+        shardBegin[shard] = offset;
+        for (size_t chunk = 0; chunk < chunks; chunk++) {
+            offsets[chunk * shards + shard] = offset;
+            offset += counts[chunk * shards + shard];
+        }
+    }
+    shardBegin[shards] = n;
+    vector<ShardEntry> entries(n);
+    parallelFor(n, chunks, [&](size_t chunk, size_t begin, size_t end) {
+        size_t* next = &offsets[chunk * shards];
+        for (size_t i = begin; i < end; i++) {
+            ShardEntry& entry = entries[next[shardOf(hashes[i])]++];
+            entry.key = key(i);
+            entry.index = (uint32_t) i;
+            entry.hash = hashes[i];
+        }
+    });
+
+    // each shard is deduplicated with its own open addressing table, the
+    // first vertex with a key represents the others
+    vector<uint32_t> representative(n);
+    parallelFor(shards, chunks, [&](size_t, size_t firstShard, size_t lastShard) {
+        vector<uint32_t> table;
+        for (size_t shard = firstShard; shard < lastShard; shard++) {
+            size_t begin = shardBegin[shard], end = shardBegin[shard + 1];
+            size_t capacity = 16;
+            while (capacity < 2 * (end - begin)) capacity *= 2;
+            table.assign(capacity, EMPTY);
+            const ShardEntry* shardEntries = &entries[begin];
+            for (uint32_t k = 0; k < end - begin; k++) {
+                const ShardEntry& entry = shardEntries[k];
+                size_t slot = entry.hash & (capacity - 1);
+                while (true) {
+                    uint32_t found = table[slot];
+                    if (found == EMPTY) {
+                        table[slot] = k;
+                        representative[entry.index] = entry.index;
+                        break;
+                    }
+                    const ShardEntry& other = shardEntries[found];
+                    if (other.hash == entry.hash && other.key == entry.key) {
+                        representative[entry.index] = other.index;
+                        break;
+                    }
+                    slot = (slot + 1) & (capacity - 1);
+                }
+            }
+        }
+    });
+
+    // number the representatives in index order, as the vertices are met
+    // by a serial loop, and copy them to the output
+    vector<size_t> uniqueBegin(chunks + 1, 0);
+    parallelFor(n, chunks, [&](size_t chunk, size_t begin, size_t end) {
+        size_t count = 0;
+        for (size_t i = begin; i < end; i++) count += representative[i] == i;
+        uniqueBegin[chunk + 1] = count;
+    });
+    for (size_t chunk = 0; chunk < chunks; chunk++) uniqueBegin[chunk + 1] += uniqueBegin[chunk];
+
+    size_t base = out_vertices.size(), indexBase = out_indices.size();
+    out_vertices.resize(base + uniqueBegin[chunks]);
+    if (in_uvs.size() != 0) out_uvs.resize(base + uniqueBegin[chunks]);
+    if (in_normals.size() != 0) out_normals.resize(base + uniqueBegin[chunks]);
+    out_indices.resize(indexBase + n);
+    vector<uint32_t> outIndex(n);
+    parallelFor(n, chunks, [&](size_t chunk, size_t begin, size_t end) {
+        size_t next = base + uniqueBegin[chunk];
+        for (size_t i = begin; i < end; i++) {
+            if (representative[i] != i) continue;
+            outIndex[i] = (uint32_t) next;
+            out_vertices[next] = in_vertices[i];
+            if (in_uvs.size() != 0) out_uvs[next] = in_uvs[i];
+            if (in_normals.size() != 0) out_normals[next] = in_normals[i];
+            next++;
+        }
+    });
+    parallelFor(n, chunks, [&](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            out_indices[indexBase + i] = outIndex[representative[i]];
+        }
+    });
+}
+
+// Interleaved vertex stride of a VertexFormat
+static GLsizei vertexStride(VertexFormat format) {
+    return format == VERTEX_QUANTIZED ? sizeof(QuantizedVertex) : 8 * sizeof(float);
+}
+
+// Interleave the indexed arrays in format, normals and uvs may be empty
+static vector<uint8_t> packVertices(
+        VertexFormat format, const vector<vec3>& positions, const vector<vec3>& normals,
+        const vector<vec2>& uvs, const vec3& boundsMin, const vec3& boundsMax,
+        VertexQuantization& quantization) {
+    vector<uint8_t> bytes(positions.size() * vertexStride(format), 0);
+    if (format == VERTEX_QUANTIZED) {
+        vector<QuantizedVertex> quantized = quantizeVertices(positions, normals, uvs, boundsMin, boundsMax, quantization);
+        memcpy(bytes.data(), quantized.data(), bytes.size());
+        return bytes;
+    }
+
+    quantization = VertexQuantization();
+    float* vertex = (float*) bytes.data();
+    for (size_t v = 0; v < positions.size(); v++, vertex += 8) {
+        vertex[0] = positions[v].x;
+        vertex[1] = positions[v].y;
+        vertex[2] = positions[v].z;
+        if (v < normals.size()) {
+            vertex[3] = normals[v].x;
+            vertex[4] = normals[v].y;
+            vertex[5] = normals[v].z;
+        }
+        if (v < uvs.size()) {
+            vertex[6] = uvs[v].x;
+            vertex[7] = uvs[v].y;
         }
     }
+    return bytes;
 }
 
-Drawable::Drawable(string path) {
-    if (path.substr(path.size() - 3, 3) == "obj") {
-        loadOBJWithTiny(path.c_str(), vertices, uvs, normals, VEC_UINT_DEFAUTL_VALUE);
-    } else if (path.substr(path.size() - 3, 3) == "vtp") {
-        loadVTP(path.c_str(), vertices, uvs, normals, VEC_UINT_DEFAUTL_VALUE);
-    } else {
-        throw runtime_error("File format not supported: " + path);
+// Attribute pointers 0 (position), 1 (normal) and 2 (uv) into the bound GL_ARRAY_BUFFER
+static void setVertexAttributes(VertexFormat format, bool normals, bool uvs) {
+    if (format == VERTEX_QUANTIZED) {
+        bindQuantizedAttributes(normals, uvs);
+        return;
+    }
+    GLsizei stride = vertexStride(format);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*) 0);
+    glEnableVertexAttribArray(0);
+    if (normals) {
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*) (3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
     }
+    if (uvs) {
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*) (6 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+    }
+}
+
+template <typename T>
+static size_t heapBytes(const vector<T>& v) {
+    return v.capacity() * sizeof(T);
+}
+
+// clear() keeps the capacity
+template <typename T>
+static void freeArray(vector<T>& v) {
+    vector<T>().swap(v);
+}
 
-    createContext();
+// The CPU arrays of a Drawable or Mesh that residency does not keep
+template <typename M>
+static void releaseArrays(M& mesh, Residency residency) {
+    if (residency == RESIDENCY_KEEP) return;
+    freeArray(mesh.vertices);
+    freeArray(mesh.normals);
+    freeArray(mesh.uvs);
+    freeArray(mesh.indexedNormals);
+    freeArray(mesh.indexedUVS);
+    if (residency == RESIDENCY_DROP_AFTER_UPLOAD) {
+        freeArray(mesh.indexedVertices);
+        freeArray(mesh.indices);
+    }
+}
+
+template <typename M>
+static size_t arrayBytes(const M& mesh) {
+    return heapBytes(mesh.vertices) + heapBytes(mesh.normals) + heapBytes(mesh.uvs) +
+           heapBytes(mesh.indexedVertices) + heapBytes(mesh.indexedNormals) + heapBytes(mesh.indexedUVS) +
+           heapBytes(mesh.indices) + heapBytes(mesh.lods);
+}
+
+// Simplified levels of detail after the full mesh. Returns the indices of all
+// levels, each vertex cache optimized, and their ranges in lods
+static vector<unsigned int> buildLODs(const vector<unsigned int>& indices, const vector<vec3>& positions,
+                                      const vector<vec3>& normals, const vector<vec2>& uvs,
+                                      vector<LODRange>& lods) {
+    vector<MeshLOD> chain = buildLODChain(indices, positions, normals, uvs);
+    vector<unsigned int> all = indices;
+    lods.assign(1, {0, (unsigned int) indices.size(), 0.0f});
+    for (size_t level = 1; level < chain.size(); level++) {
+        optimizeVertexCache(chain[level].indices, positions.size());
+        lods.push_back({(unsigned int) all.size(), (unsigned int) chain[level].indices.size(), chain[level].error});
+        all.insert(all.end(), chain[level].indices.begin(), chain[level].indices.end());
+    }
+    return all;
+}
+
+Drawable::Drawable(string path, bool optimize, VertexFormat format, Residency residency)
+        : format(format), residency(residency), optimize(optimize) {
+    load(path);
+    upload();
+}
+
+Drawable::Drawable(string path, AsyncLoader& loader, bool optimize, VertexFormat format, Residency residency)
+        : format(format), residency(residency), optimize(optimize) {
+    loader.run([this, path] { load(path); }, [this] { upload(); });
 }
 
 Drawable::Drawable(const vector<vec3>& vertices, const vector<vec2>& uvs,
-                   const vector<vec3>& normals) : vertices(vertices), uvs(uvs), normals(normals) {
-    createContext();
+                   const vector<vec3>& normals, VertexFormat format)
+        : vertices(vertices), normals(normals), uvs(uvs), format(format), residency(RESIDENCY_KEEP),
+          optimize(true) {
+    build();
+    upload();
+}
+
+void Drawable::load(const string& path) {
+    string extension = path.substr(path.size() - 3, 3);
+    if (extension != "obj" && extension != "vtp") {
+        throw runtime_error("File format not supported: " + path);
+    }
+
+    uint32_t flags = (optimize ? MESH_CACHE_OPTIMIZED : 0) | (format == VERTEX_QUANTIZED ? MESH_CACHE_QUANTIZED : 0);
+    auto cache = MeshCache::open(path, vertexStride(format), flags, MESH_CACHE_OPTIMIZED | MESH_CACHE_QUANTIZED);
+    if (cache) {
+        fromCache(std::move(cache));
+        loadingBytes = arrayBytes(*this);
+        return;
+    }
+
+    // runs on loader threads, so nothing shared; build() indexes the corners again
+    vector<unsigned int> cornerIndices;
+    if (extension == "obj") {
+        loadOBJFast(path, vertices, uvs, normals, cornerIndices);
+    } else {
+        loadVTP(path.c_str(), vertices, uvs, normals, cornerIndices);
+    }
+    loadingBytes = arrayBytes(*this) + heapBytes(cornerIndices);
+    build(path);
+    loadingBytes = arrayBytes(*this) + heapBytes(staging.vertices) + heapBytes(staging.indices);
 }
 
 Drawable::~Drawable() {
-    glDeleteBuffers(1, &verticesVBO);
-    glDeleteBuffers(1, &uvsVBO);
-    glDeleteBuffers(1, &normalsVBO);
+    // nothing to delete if a background load never finished
+    if (!VAO) return;
+    glDeleteBuffers(1, &vertexVBO);
     glDeleteBuffers(1, &elementVBO);
-    glDeleteBuffers(1, &VAO);
+    glDeleteVertexArrays(1, &VAO);
 }
 
 void Drawable::bind() {
@@ -356,46 +843,162 @@ void Drawable::bind() {
 }
 
 void Drawable::draw(int mode) {
-    glDrawElements(mode, indices.size(), GL_UNSIGNED_INT, NULL);
+    glDrawElements(mode, indexCount, GL_UNSIGNED_INT, NULL);
+}
+
+void Drawable::drawLOD(int level, int mode) {
+    const LODRange& lod = lods[level];
+    glDrawElements(mode, lod.indexCount, GL_UNSIGNED_INT, (void*) (lod.firstIndex * sizeof(unsigned int)));
+}
+
+int Drawable::selectLOD(const LODSelector& selector) const {
+    return selector.select(lods, (boundsMin + boundsMax) * 0.5f, length(boundsMax - boundsMin) * 0.5f);
+}
+
+void Drawable::bindVertexAttributes() {
+    glBindBuffer(GL_ARRAY_BUFFER, vertexVBO);
+    setVertexAttributes(format, hasNormals, hasUVs);
+}
+
+size_t Drawable::hostMemoryBytes() const {
+    // a background load may still be writing the arrays, it reports what it holds
+    return isUploaded() ? arrayBytes(*this) : loadingBytes.load();
 }
 
-void Drawable::createContext() {
+void Drawable::optimizeIndices() {
+    size_t vertexCount = indexedVertices.size();
+    float before = computeACMR(indices, vertexCount);
+
+    vector<size_t> clusters;
+    optimizeVertexCache(indices, vertexCount, 16, &clusters);
+    optimizeOverdraw(indices, clusters, indexedVertices);
+
+    vector<unsigned int> remap = optimizeVertexFetch(indices, vertexCount);
+    remapVertices(indexedVertices, remap);
+    remapVertices(indexedUVS, remap);
+    remapVertices(indexedNormals, remap);
+
+    // reported by upload(), this may run on a loader thread
+    staging.acmrBefore = before;
+    staging.acmrAfter = computeACMR(indices, indexedVertices.size());
+}
+
+void Drawable::build(const string& cacheSource) {
     indices = vector<unsigned int>();
     indexVBO(vertices, uvs, normals, indices, indexedVertices, indexedUVS, indexedNormals);
+    if (optimize) {
+        optimizeIndices();
+    }
 
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
+    vertexCount = (GLsizei) indexedVertices.size();
+    indexCount = (GLsizei) indices.size();
+    hasNormals = indexedNormals.size() != 0;
+    hasUVs = indexedUVS.size() != 0;
+    boundsMin = vertexCount ? indexedVertices[0] : vec3(0.0f);
+    boundsMax = boundsMin;
+    for (const auto& position : indexedVertices) {
+        boundsMin = glm::min(boundsMin, position);
+        boundsMax = glm::max(boundsMax, position);
+    }
+    vector<unsigned int> allIndices = indices;
+    lods.assign(1, {0, (unsigned int) indices.size(), 0.0f});
+    if (optimize) {
+        allIndices = buildLODs(indices, indexedVertices, indexedNormals, indexedUVS, lods);
+    }
+    staging.vertices = packVertices(format, indexedVertices, indexedNormals, indexedUVS,
+                                    boundsMin, boundsMax, quantization);
+
+    if (!cacheSource.empty()) {
+        uint32_t flags = (hasNormals ? MESH_CACHE_NORMALS : 0) | (hasUVs ? MESH_CACHE_UVS : 0) |
+                         (optimize ? MESH_CACHE_OPTIMIZED : 0) |
+                         (format == VERTEX_QUANTIZED ? MESH_CACHE_QUANTIZED : 0);
+        MeshCache::write(cacheSource, flags, staging.vertices.data(), vertexStride(format), vertexCount,
+                         allIndices.data(), allIndices.size(), lods.data(), lods.size(), boundsMin, boundsMax);
+    }
+    staging.indices.swap(allIndices);
+}
 
-    glGenBuffers(1, &verticesVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, verticesVBO);
-    glBufferData(GL_ARRAY_BUFFER, indexedVertices.size() * sizeof(vec3),
-                 &indexedVertices[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(0);
+void Drawable::fromCache(unique_ptr<MeshCache> mapped) {
+    const MeshCache& cache = *mapped;
+    const MeshCacheHeader& header = cache.header();
+    vertexCount = (GLsizei) header.vertexCount;
+    lods.assign(1, {0, (unsigned int) header.indexCount, 0.0f});
+    if (header.lodCount > 0) lods.assign(cache.lods(), cache.lods() + header.lodCount);
+    indexCount = (GLsizei) lods[0].indexCount;
+    hasNormals = (header.flags & MESH_CACHE_NORMALS) != 0;
+    hasUVs = (header.flags & MESH_CACHE_UVS) != 0;
+    boundsMin = vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+    boundsMax = vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+    staging.cache = std::move(mapped);
+    quantization = VertexQuantization();
+    if (format == VERTEX_QUANTIZED) {
+        quantization.offset = boundsMin;
+        quantization.scale = boundsMax - boundsMin;
+        quantization.octahedralNormals = true;
+    }
+    if (residency == RESIDENCY_DROP_AFTER_UPLOAD) return;
+
+    // CPU copies for the users of the indexed arrays the residency keeps, dequantized if needed
+    bool keepNormals = hasNormals && residency == RESIDENCY_KEEP;
+    bool keepUVs = hasUVs && residency == RESIDENCY_KEEP;
+    indices.assign(cache.indices(), cache.indices() + indexCount);
+    indexedVertices.resize(vertexCount);
+    if (keepNormals) indexedNormals.resize(vertexCount);
+    if (keepUVs) indexedUVS.resize(vertexCount);
+    if (format == VERTEX_QUANTIZED) {
+        const QuantizedVertex* quantized = (const QuantizedVertex*) cache.vertices();
+        for (GLsizei v = 0; v < vertexCount; v++) {
+            const QuantizedVertex& vertex = quantized[v];
+            vec3 stored(vertex.position[0], vertex.position[1], vertex.position[2]);
+            indexedVertices[v] = quantization.offset + stored / 65535.0f * quantization.scale;
+            if (keepNormals) {
+                indexedNormals[v] = decodeOctahedral(glm::max(vec2(vertex.normal[0], vertex.normal[1]) / 32767.0f, vec2(-1.0f)));
+            }
+            if (keepUVs) indexedUVS[v] = vec2(unpackHalf1x16(vertex.uv[0]), unpackHalf1x16(vertex.uv[1]));
+        }
+        return;
+    }
 
-    if (indexedNormals.size() != 0) {
-        glGenBuffers(1, &normalsVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, normalsVBO);
-        glBufferData(GL_ARRAY_BUFFER, indexedNormals.size() * sizeof(vec3),
-                     &indexedNormals[0], GL_STATIC_DRAW);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray(1);
+    const float* interleaved = (const float*) cache.vertices();
+    for (GLsizei v = 0; v < vertexCount; v++) {
+        const float* vertex = interleaved + v * 8;
+        indexedVertices[v] = vec3(vertex[0], vertex[1], vertex[2]);
+        if (keepNormals) indexedNormals[v] = vec3(vertex[3], vertex[4], vertex[5]);
+        if (keepUVs) indexedUVS[v] = vec2(vertex[6], vertex[7]);
     }
+}
 
-    if (indexedUVS.size() != 0) {
-        glGenBuffers(1, &uvsVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, uvsVBO);
-        glBufferData(GL_ARRAY_BUFFER, indexedUVS.size() * sizeof(vec2),
-                     &indexedUVS[0], GL_STATIC_DRAW);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray(2);
+void Drawable::upload() {
+    // straight from the mapped cache when there is one
+    const void* vertexData = staging.vertices.data();
+    const unsigned int* indexData = staging.indices.data();
+    size_t indexTotal = staging.indices.size();
+    if (staging.cache) {
+        vertexData = staging.cache->vertices();
+        indexData = staging.cache->indices();
+        indexTotal = staging.cache->header().indexCount;
     }
 
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+
+    glGenBuffers(1, &vertexVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexVBO);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) vertexCount * vertexStride(format), vertexData, GL_STATIC_DRAW);
+    setVertexAttributes(format, hasNormals, hasUVs);
+
     // Generate a buffer for the indices as well
     glGenBuffers(1, &elementVBO);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementVBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
-                 &indices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr) (indexTotal * sizeof(unsigned int)),
+                 indexData, GL_STATIC_DRAW);
+    if (staging.acmrAfter > 0.0f) {
+        cout << "Vertex cache ACMR " << staging.acmrBefore << " -> " << staging.acmrAfter
+             << " (" << indexCount / 3 << " triangles, " << vertexCount << " vertices)" << endl;
+    }
+    staging = Staging();
+    releaseArrays(*this, residency);
+    loadingBytes = 0;
 }
 
 /*****************************************************************************/
@@ -404,105 +1007,304 @@ Mesh::Mesh(
         const vector<vec3>& vertices,
         const vector<vec2>& uvs,
         const vector<vec3>& normals,
-        const Material& mtl)
-        : vertices{vertices}, uvs{uvs}, normals{normals}, mtl{mtl} {
-    createContext();
-}
-
-Mesh::Mesh(Mesh&& other)
-        : vertices{std::move(other.vertices)}, normals{std::move(other.normals)},
-          indexedVertices{std::move(other.indexedVertices)}, indexedNormals{std::move(other.indexedNormals)},
-          uvs{std::move(other.uvs)}, indexedUVS{std::move(other.indexedUVS)},
-          indices{std::move(other.indices)}, mtl{std::move(other.mtl)},
-          VAO{other.VAO}, verticesVBO{other.verticesVBO}, normalsVBO{other.normalsVBO},
-          uvsVBO{other.uvsVBO}, elementVBO{other.elementVBO} {
-    other.VAO = 0;
-    other.verticesVBO = 0;
-    other.normalsVBO = 0;
-    other.uvsVBO = 0;
-    other.elementVBO = 0;
-}
-
-Mesh::~Mesh() {
-    glDeleteBuffers(1, &verticesVBO);
-    glDeleteBuffers(1, &uvsVBO);
-    glDeleteBuffers(1, &normalsVBO);
-    glDeleteBuffers(1, &elementVBO);
-    glDeleteVertexArrays(1, &VAO);
+        const Material& mtl,
+        int materialId)
+        : vertices{vertices}, normals{normals}, uvs{uvs}, mtl{mtl}, materialId{materialId} {
+    prepare();
 }
 
-void Mesh::bind() {
-    glBindVertexArray(VAO);
+void Mesh::draw(int mode) {
+    drawLOD(0, mode);
 }
 
-void Mesh::draw(int mode) {
-    glDrawElements(mode, indices.size(), GL_UNSIGNED_INT, NULL);
+void Mesh::drawLOD(int level, int mode) {
+    const LODRange& lod = lods[level];
+    glDrawElementsBaseVertex(mode, lod.indexCount, GL_UNSIGNED_INT,
+                             (void*) (lod.firstIndex * sizeof(unsigned int)), baseVertex);
+}
+
+void Mesh::computeBounds() {
+    boundsMin = vec3(0.0f);
+    boundsMax = vec3(0.0f);
+    if (!indexedVertices.empty()) {
+        boundsMin = boundsMax = indexedVertices[0];
+    }
+    for (const auto& v : indexedVertices) {
+        boundsMin = glm::min(boundsMin, v);
+        boundsMax = glm::max(boundsMax, v);
+    }
+    // sphere around the box center, not minimal but tight enough for culling
+    center = (boundsMin + boundsMax) * 0.5f;
+    radius = 0.0f;
+    for (const auto& v : indexedVertices) {
+        radius = std::max(radius, length(v - center));
+    }
 }
 
-void Mesh::createContext() {
+void Mesh::prepare() {
     indices = vector<unsigned int>();
     indexVBO(vertices, uvs, normals, indices, indexedVertices, indexedUVS, indexedNormals);
+    computeBounds();
+    lodIndices = buildLODs(indices, indexedVertices, indexedNormals, indexedUVS, lods);
+}
 
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
+void Mesh::release(Residency residency) {
+    releaseArrays(*this, residency);
+}
 
-    glGenBuffers(1, &verticesVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, verticesVBO);
-    glBufferData(GL_ARRAY_BUFFER, indexedVertices.size() * sizeof(vec3),
-                 &indexedVertices[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(0);
+size_t Mesh::hostMemoryBytes() const {
+    return arrayBytes(*this) + heapBytes(lodIndices);
+}
 
-    if (indexedNormals.size() != 0) {
-        glGenBuffers(1, &normalsVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, normalsVBO);
-        glBufferData(GL_ARRAY_BUFFER, indexedNormals.size() * sizeof(vec3),
-                     &indexedNormals[0], GL_STATIC_DRAW);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray(1);
+Model::Model(string path, Model::MTLUploadFunction* uploader, VertexFormat format, AsyncLoader* loader,
+             AssetRegistry* assets, Residency residency)
+        : uploadFunction{uploader}, assets{assets}, format{format}, residency{residency},
+          drawnMeshes{0}, drawCalls{0}, loaded{false} {
+    if (path.substr(path.size() - 3, 3) != "obj") {
+        throw runtime_error("File format not supported: " + path);
+    }
+    if (!loader) {
+        ParsedOBJ parsed = parseOBJ(path);
+        merge(parsed, format);
+        finishLoading(parsed, nullptr);
+        return;
     }
+    // the meshes are parsed, indexed and merged on a worker, uploaded with their textures on the GL thread
+    auto parsed = make_shared<ParsedOBJ>();
+    loader->run([this, parsed, path, format] {
+                    *parsed = parseOBJ(path);
+                    pendingBytes = parsedBytes(*parsed);
+                    merge(*parsed, format);
+                    pendingBytes = parsedBytes(*parsed);
+                },
+                [this, parsed, loader] { finishLoading(*parsed, loader); });
+}
 
-    if (indexedUVS.size() != 0) {
-        glGenBuffers(1, &uvsVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, uvsVBO);
-        glBufferData(GL_ARRAY_BUFFER, indexedUVS.size() * sizeof(vec2),
-                     &indexedUVS[0], GL_STATIC_DRAW);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray(2);
+void Model::finishLoading(ParsedOBJ& parsed, AsyncLoader* loader) {
+    for (size_t i = 0; i < parsed.meshes.size(); i++) {
+        Mesh& mesh = parsed.meshes[i];
+        const auto& names = parsed.textureNames[i];
+        Material& mtl = mesh.mtl;
+        mtl.texKa = loadTexture(names[0], loader);
+        mtl.texKd = loadTexture(names[1], loader);
+        mtl.texKs = loadTexture(names[2], loader);
+        mtl.texNs = loadTexture(names[3], loader);
+        if (mtl.texKa) mtl.Ka.r = -1.0f;
+        if (mtl.texKd) mtl.Kd.r = -1.0f;
+        if (mtl.texKs) mtl.Ks.r = -1.0f;
+        if (mtl.texNs) mtl.Ns = -1.0f;
+        mesh.release(residency);
     }
 
-    // Generate a buffer for the indices as well
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+
+    glGenBuffers(1, &vertexVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexVBO);
+    glBufferData(GL_ARRAY_BUFFER, parsed.vertices.size(), parsed.vertices.data(), GL_STATIC_DRAW);
+    setVertexAttributes(format, parsed.hasNormals, parsed.hasUVs);
+
+    // the indices of all meshes and levels
     glGenBuffers(1, &elementVBO);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementVBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
-                 &indices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, parsed.indices.size() * sizeof(unsigned int),
+                 parsed.indices.data(), GL_STATIC_DRAW);
+
+    quantization = parsed.quantization;
+    meshes = std::move(parsed.meshes);
+    groups = std::move(parsed.groups);
+    meshLevels.assign(meshes.size(), -1);
+    buildBVH();
+    loaded = true;
+    pendingBytes = 0;
 }
 
-Model::Model(string path, Model::MTLUploadFunction* uploader)
-        : uploadFunction{uploader} {
-    if (path.substr(path.size() - 3, 3) == "obj") {
-        loadOBJWithTiny(path.c_str());
-    } else {
-        throw runtime_error("File format not supported: " + path);
+void Model::merge(ParsedOBJ& parsed, VertexFormat format) {
+    // stable, the meshes of a material stay in file order
+    vector<size_t> order(parsed.meshes.size());
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return parsed.meshes[a].materialId < parsed.meshes[b].materialId;
+    });
+    vector<Mesh> sorted;
+    vector<array<string, 4>> textureNames;
+    sorted.reserve(order.size());
+    for (size_t i : order) {
+        sorted.push_back(std::move(parsed.meshes[i]));
+        textureNames.push_back(parsed.textureNames[i]);
+    }
+    parsed.meshes.swap(sorted);
+    parsed.textureNames.swap(textureNames);
+
+    // one quantization over the bounds of the whole model, meshes share the buffer
+    vec3 boundsMin(0.0f), boundsMax(0.0f);
+    for (size_t i = 0; i < parsed.meshes.size(); i++) {
+        const Mesh& mesh = parsed.meshes[i];
+        boundsMin = i == 0 ? mesh.boundsMin : glm::min(boundsMin, mesh.boundsMin);
+        boundsMax = i == 0 ? mesh.boundsMax : glm::max(boundsMax, mesh.boundsMax);
+        parsed.hasNormals = parsed.hasNormals || !mesh.indexedNormals.empty();
+        parsed.hasUVs = parsed.hasUVs || !mesh.indexedUVS.empty();
+    }
+
+    size_t stride = vertexStride(format);
+    for (size_t i = 0; i < parsed.meshes.size(); i++) {
+        Mesh& mesh = parsed.meshes[i];
+        if (i == 0 || mesh.materialId != parsed.meshes[i - 1].materialId) {
+            parsed.groups.push_back({(unsigned int) i, 0});
+        }
+        parsed.groups.back().meshCount++;
+
+        mesh.baseVertex = (GLint) (parsed.vertices.size() / stride);
+        vector<uint8_t> vertices = packVertices(format, mesh.indexedVertices, mesh.indexedNormals, mesh.indexedUVS,
+                                                boundsMin, boundsMax, parsed.quantization);
+        parsed.vertices.insert(parsed.vertices.end(), vertices.begin(), vertices.end());
+
+        unsigned int firstIndex = (unsigned int) parsed.indices.size();
+        for (auto& lod : mesh.lods) lod.firstIndex += firstIndex;
+        parsed.indices.insert(parsed.indices.end(), mesh.lodIndices.begin(), mesh.lodIndices.end());
+        freeArray(mesh.lodIndices);
     }
 }
 
+void Model::setResidency(Residency policy) {
+    residency = policy;
+    for (auto& mesh : meshes) mesh.release(residency);
+}
+
+size_t Model::hostMemoryBytes() const {
+    size_t bytes = heapBytes(meshes) + heapBytes(groups) + heapBytes(bvh) + heapBytes(bvhMeshes) +
+                   heapBytes(meshLevels) + heapBytes(drawCounts) + heapBytes(drawOffsets) + heapBytes(drawBaseVertices);
+    for (const auto& mesh : meshes) bytes += mesh.hostMemoryBytes();
+    return bytes + pendingBytes.load();
+}
+
+size_t Model::parsedBytes(const ParsedOBJ& parsed) {
+    size_t bytes = heapBytes(parsed.meshes) + heapBytes(parsed.textureNames) + heapBytes(parsed.groups) +
+                   heapBytes(parsed.vertices) + heapBytes(parsed.indices);
+    for (const auto& mesh : parsed.meshes) bytes += mesh.hostMemoryBytes();
+    return bytes;
+}
+
 Model::~Model() {
-    for (const auto& t : textures) {
-        glDeleteTextures(1, &t.second);
-    }
+    if (!VAO) return;
+    glDeleteBuffers(1, &vertexVBO);
+    glDeleteBuffers(1, &elementVBO);
+    glDeleteVertexArrays(1, &VAO);
+}
+
+// Dequantization uniforms of the program in use
+static DequantizeUniforms currentDequantizeUniforms() {
+    GLint program = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+    return DequantizeUniforms::locate((GLuint) program);
 }
 
 void Model::draw() {
-    for (auto& mesh : meshes) {
-        mesh.bind();
+    fill(meshLevels.begin(), meshLevels.end(), 0);
+    drawGroups();
+}
+
+void Model::drawGroups() {
+    drawnMeshes = 0;
+    drawCalls = 0;
+    if (groups.empty()) return;
+    glBindVertexArray(VAO);
+    currentDequantizeUniforms().upload(quantization);
+    for (const auto& group : groups) {
+        drawCounts.clear();
+        drawOffsets.clear();
+        drawBaseVertices.clear();
+        for (unsigned int m = group.firstMesh; m < group.firstMesh + group.meshCount; m++) {
+            if (meshLevels[m] < 0) continue;
+            const LODRange& lod = meshes[m].lods[meshLevels[m]];
+            drawCounts.push_back((GLsizei) lod.indexCount);
+            drawOffsets.push_back((void*) (lod.firstIndex * sizeof(unsigned int)));
+            drawBaseVertices.push_back(meshes[m].baseVertex);
+        }
+        if (drawCounts.empty()) continue;
         if (uploadFunction)
-            uploadFunction(mesh.mtl);
-        mesh.draw();
+            uploadFunction(meshes[group.firstMesh].mtl);
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, drawCounts.data(), GL_UNSIGNED_INT, drawOffsets.data(),
+                                      (GLsizei) drawCounts.size(), drawBaseVertices.data());
+        drawnMeshes += (int) drawCounts.size();
+        drawCalls++;
+    }
+}
+
+void Model::draw(const mat4& PV, const LODSelector* selector) {
+    Frustum frustum(PV);
+    fill(meshLevels.begin(), meshLevels.end(), -1);
+
+    // stackless traversal: a culled inner node jumps over its subtree
+    unsigned int i = 0;
+    while (i < bvh.size()) {
+        const BVHNode& node = bvh[i];
+        bool visible = frustum.intersectsAABB(node.min, node.max);
+        if (node.count == 0) {
+            i = visible ? i + 1 : node.skipOrFirst;
+            continue;
+        }
+        if (visible) {
+            for (unsigned int k = 0; k < node.count; k++) {
+                unsigned int m = bvhMeshes[node.skipOrFirst + k];
+                const Mesh& mesh = meshes[m];
+                if (node.count > 1 && !frustum.intersectsAABB(mesh.boundsMin, mesh.boundsMax)) continue;
+                meshLevels[m] = selector ? selector->select(mesh.lods, mesh.center, mesh.radius) : 0;
+            }
+        }
+        i++;
+    }
+    drawGroups();
+}
+
+void Model::buildBVH() {
+    bvhMeshes.resize(meshes.size());
+    iota(bvhMeshes.begin(), bvhMeshes.end(), 0);
+    bvh.clear();
+    bvh.reserve(2 * meshes.size());
+    if (!meshes.empty()) {
+        buildBVHNode(0, (unsigned int) meshes.size());
+    }
+}
+
+void Model::buildBVHNode(unsigned int begin, unsigned int end) {
+    unsigned int index = (unsigned int) bvh.size();
+    bvh.push_back(BVHNode{});
+
+    BVHNode node;
+    node.min = meshes[bvhMeshes[begin]].boundsMin;
+    node.max = meshes[bvhMeshes[begin]].boundsMax;
+    vec3 centerMin = meshes[bvhMeshes[begin]].center, centerMax = centerMin;
+    for (unsigned int i = begin; i < end; i++) {
+        const Mesh& mesh = meshes[bvhMeshes[i]];
+        node.min = glm::min(node.min, mesh.boundsMin);
+        node.max = glm::max(node.max, mesh.boundsMax);
+        centerMin = glm::min(centerMin, mesh.center);
+        centerMax = glm::max(centerMax, mesh.center);
+    }
+
+    if (end - begin <= MAX_LEAF_MESHES) {
+        node.skipOrFirst = begin;
+        node.count = end - begin;
+        bvh[index] = node;
+        return;
     }
+
+    // median split of the mesh centers along the longest axis
+    vec3 extent = centerMax - centerMin;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    unsigned int middle = (begin + end) / 2;
+    nth_element(bvhMeshes.begin() + begin, bvhMeshes.begin() + middle, bvhMeshes.begin() + end,
+                [&](unsigned int a, unsigned int b) { return meshes[a].center[axis] < meshes[b].center[axis]; });
+
+    buildBVHNode(begin, middle);
+    buildBVHNode(middle, end);
+    node.skipOrFirst = (unsigned int) bvh.size();
+    node.count = 0;
+    bvh[index] = node;
 }
 
-void Model::loadOBJWithTiny(const std::string& filename) {
+Model::ParsedOBJ Model::parseOBJ(const std::string& filename) {
     tinyobj::attrib_t attrib;
     vector<tinyobj::shape_t> shapes;
     vector<tinyobj::material_t> materials;
@@ -512,13 +1314,7 @@ void Model::loadOBJWithTiny(const std::string& filename) {
         throw runtime_error(err);
     }
 
-    for (const auto& material : materials) {
-        loadTexture(material.ambient_texname);
-        loadTexture(material.diffuse_texname);
-        loadTexture(material.specular_texname);
-        loadTexture(material.specular_highlight_texname);
-    }
-
+    ParsedOBJ parsed;
     for (const auto& shape : shapes) {
         vector<vec3> vertices{};
         vector<vec2> uvs{};
@@ -550,8 +1346,10 @@ void Model::loadOBJWithTiny(const std::string& filename) {
             vertices.push_back(vertex);
         }
         Material mtl{};
+        array<string, 4> textureNames;
+        int idx = -1;
         if (materials.size() > 0 && shape.mesh.material_ids.size() > 0) {
-            int idx = shape.mesh.material_ids[0];
+            idx = shape.mesh.material_ids[0];
             if (idx < 0 || idx >= static_cast<int>(materials.size()))
                 idx = static_cast<int>(materials.size()) - 1;
             tinyobj::material_t mat = materials[idx];
@@ -560,25 +1358,25 @@ void Model::loadOBJWithTiny(const std::string& filename) {
                     {mat.diffuse[0], mat.diffuse[1], mat.diffuse[2], 1},
                     {mat.specular[0], mat.specular[1], mat.specular[2], 1},
                     mat.shininess,
-                    textures[mat.ambient_texname],
-                    textures[mat.diffuse_texname],
-                    textures[mat.specular_texname],
-                    textures[mat.specular_highlight_texname]
+                    0, 0, 0, 0
             };
-            if (mtl.texKa) mtl.Ka.r = -1.0f;
-            if (mtl.texKd) mtl.Kd.r = -1.0f;
-            if (mtl.texKs) mtl.Ks.r = -1.0f;
-            if (mtl.texNs) mtl.Ns = -1.0f;
+            // the textures are resolved on the GL thread, see finishLoading()
+            textureNames = {mat.ambient_texname, mat.diffuse_texname,
+                            mat.specular_texname, mat.specular_highlight_texname};
         }
-        meshes.emplace_back(vertices, uvs, normals, mtl);
+        parsed.meshes.emplace_back(vertices, uvs, normals, mtl, idx);
+        parsed.textureNames.push_back(textureNames);
     }
+    return parsed;
 }
 
-void Model::loadTexture(const std::string& filename) {
-    if (filename.length() == 0) return;
-    if (textures.find(filename) == end(textures)) {
-        GLuint id = loadSOIL(filename.c_str());
-        if (!id) throw std::runtime_error("Failed to load texture: " + filename);
-        textures[filename] = id;
+GLuint Model::loadTexture(const std::string& filename, AsyncLoader* loader) {
+    if (filename.length() == 0) return 0;
+    TextureHandle& texture = textures[filename];
+    if (!texture) {
+        // without a registry the textures are shared among the meshes of this model only
+        AssetRegistry own;
+        texture = (assets ? assets : &own)->texture(filename, loader);
     }
+    return texture->name;
 }
\ No newline at end of file
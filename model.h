@@ -5,33 +5,40 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <array>
+#include <memory>
+#include <atomic>
+#include <cstdint>
 #include <glm/glm.hpp>
+#include "common/quantize.h"
+#include "common/simplify.h"
 
-static std::vector<unsigned int> VEC_UINT_DEFAUTL_VALUE{};
 static std::vector<glm::vec3> VEC_VEC3_DEFAUTL_VALUE{};
 static std::vector<glm::vec2> VEC_VEC2_DEFAUTL_VALUE{};
 static std::map<std::string, GLuint> MAP_STRING_GLUINT_DEFAULT_VALUE{};
 /**
-* A very simple .obj loader. Use only for teaching purposes. Use loadOBJWithTiny()
-* instead.
+* A very simple .obj loader. Use only for teaching purposes. Use loadOBJFast()
+* or loadOBJWithTiny() instead.
 */
 void loadOBJ(
         const std::string& path,
         std::vector<glm::vec3>& vertices,
         std::vector<glm::vec2>& uvs,
         std::vector<glm::vec3>& normals,
-        std::vector<unsigned int>& indices = VEC_UINT_DEFAUTL_VALUE
+        std::vector<unsigned int>& indices
 );
 
 /**
-* A .vtp loader.
+* A .vtp loader, polygons are triangulated as fans. Reads ascii, base64 and
+* appended arrays, zlib compressed with VTP_WITH_ZLIB, see VTKDataReader.
+* Normals come from the PointData normals if there are any.
 */
 void loadVTP(
         const std::string& path,
         std::vector<glm::vec3>& vertices,
         std::vector<glm::vec2>& uvs,
         std::vector<glm::vec3>& normals,
-        std::vector<unsigned int>& indices = VEC_UINT_DEFAUTL_VALUE
+        std::vector<unsigned int>& indices
 );
 
 /**
@@ -44,11 +51,39 @@ void loadOBJWithTiny(
         std::vector<glm::vec3>& verticies,
         std::vector<glm::vec2>& uvs,
         std::vector<glm::vec3>& normals,
-        std::vector<unsigned int>& indices = VEC_UINT_DEFAUTL_VALUE
+        std::vector<unsigned int>& indices
 );
 
+/**
+* Same output as loadOBJWithTiny(), parsed in parallel: the mapped file is
+* split in chunks at line starts, a first pass counts the attributes and
+* triangles of every chunk and their prefix sums tell each chunk where to
+* write (and how to resolve negative indices) in the second pass. Numbers
+* are read with std::from_chars. Polygons are triangulated as fans.
+*/
+void loadOBJFast(
+        const std::string& path,
+        std::vector<glm::vec3>& vertices,
+        std::vector<glm::vec2>& uvs,
+        std::vector<glm::vec3>& normals,
+        std::vector<unsigned int>& indices
+);
+
+/**
+* Load path runs times with loadOBJ, loadOBJWithTiny and loadOBJFast, print
+* the best time and MB/s of each, and whether loadOBJFast matches tinyobj.
+*/
+void benchmarkOBJLoaders(const std::string& path, int runs = 3);
+
 /**
 * Create VBO indexing.
+*
+* Identical vertices are found with per shard open addressing hash tables,
+* hashed and deduplicated in parallel. The output is the same as with a
+* serial loop: unique vertices in order of first use. With weldEpsilon > 0
+* the attributes are snapped to a grid of that size before comparing, so
+* vertices that only differ by rounding are merged, the first one is kept.
+* The outputs are appended to.
 * http://www.opengl-tutorial.org/intermediate-tutorials/tutorial-9-vbo-indexing/
 */
 void indexVBO(
@@ -58,34 +93,112 @@ void indexVBO(
         std::vector<unsigned int> & out_indices,
         std::vector<glm::vec3> & out_vertices,
         std::vector<glm::vec2> & out_uvs,
-        std::vector<glm::vec3> & out_normals
+        std::vector<glm::vec3> & out_normals,
+        float weldEpsilon = 0.0f
 );
 
+class MeshCache;
+class AsyncLoader;
+class AssetRegistry;
+struct TextureAsset;
+
+/**
+* Vertex buffer layout of Drawable and ogl::Model, always interleaved.
+* VERTEX_FLOAT: position, normal, uv as floats, 32 bytes.
+* VERTEX_QUANTIZED: QuantizedVertex, 16 bytes, the vertex shader
+* dequantizes positions with the quantization of the mesh.
+*/
+enum VertexFormat { VERTEX_FLOAT, VERTEX_QUANTIZED };
+
+/**
+* What a mesh keeps in host memory once its buffers are on the GPU.
+* RESIDENCY_KEEP: all arrays, as loaded.
+* RESIDENCY_DROP_AFTER_UPLOAD: nothing but the bounds and LOD table.
+* RESIDENCY_COLLISION_ONLY: indexedVertices and indices (level 0), enough
+* for picking and collision; the other arrays are freed.
+*/
+enum Residency { RESIDENCY_KEEP, RESIDENCY_DROP_AFTER_UPLOAD, RESIDENCY_COLLISION_ONLY };
+
 class Drawable {
 public:
-    Drawable(std::string path);
+    /* optimize: reorder for the vertex cache, overdraw and vertex fetch, and
+     * build the simplified levels of detail.
+     * The indexed mesh is cached in <path>[.optimized][.quantized].meshcache,
+     * later runs upload it from the mapped cache without parsing. Then only
+     * the indexed arrays are filled, vertices, uvs and normals stay empty.
+     * residency: the arrays left after the upload, a cached mesh that drops
+     * them never builds them */
+    Drawable(std::string path, bool optimize = true, VertexFormat format = VERTEX_FLOAT,
+             Residency residency = RESIDENCY_KEEP);
+
+    /* Loads on a worker of loader and uploads in its pump(), nothing is
+     * drawn before isUploaded(). loader must outlive the load */
+    Drawable(std::string path, AsyncLoader& loader, bool optimize = true,
+             VertexFormat format = VERTEX_FLOAT, Residency residency = RESIDENCY_KEEP);
 
     Drawable(
             const std::vector<glm::vec3>& vertices,
             const std::vector<glm::vec2>& uvs = VEC_VEC2_DEFAUTL_VALUE,
-            const std::vector<glm::vec3>& normals = VEC_VEC3_DEFAUTL_VALUE);
+            const std::vector<glm::vec3>& normals = VEC_VEC3_DEFAUTL_VALUE,
+            VertexFormat format = VERTEX_FLOAT);
 
     ~Drawable();
 
     void bind();
+    bool isUploaded() const { return VAO != 0; }
 
     /* Bind VAO before calling draw */
     void draw(int mode = GL_TRIANGLES);
+    void drawLOD(int level, int mode = GL_TRIANGLES);
+    /* Level for the camera of selector, from the bounds of the model space */
+    int selectLOD(const LODSelector& selector) const;
+
+    /* Point attributes 0 (position), 1 (normal) and 2 (uv) of the bound VAO
+     * at the vertex buffer, to share it with another VAO */
+    void bindVertexAttributes();
+
+    /* Heap bytes of the arrays still held, before isUploaded() also the
+     * staging buffers of a load so far */
+    size_t hostMemoryBytes() const;
 
 public:
+    // what residency keeps of them after the upload
     std::vector<glm::vec3> vertices, normals, indexedVertices, indexedNormals;
     std::vector<glm::vec2> uvs, indexedUVS;
     std::vector<unsigned int> indices;
 
-    GLuint VAO, verticesVBO, uvsVBO, normalsVBO, elementVBO;
+    GLsizei vertexCount = 0, indexCount = 0; // indexCount: of the full mesh, level 0
+    /* Level 0 is the full mesh, all levels are in elementVBO */
+    std::vector<LODRange> lods;
+    bool hasNormals, hasUVs;
+    glm::vec3 boundsMin, boundsMax;
+    VertexFormat format;
+    /* Upload with DequantizeUniforms before drawing with a quantized format */
+    VertexQuantization quantization;
+
+    // interleaved in format
+    GLuint VAO = 0, vertexVBO = 0, elementVBO = 0;
+    Residency residency;
 
 private:
-    void createContext();
+    // buffer contents between loading (any thread) and upload (GL thread)
+    struct Staging {
+        std::unique_ptr<MeshCache> cache;
+        std::vector<uint8_t> vertices;
+        std::vector<unsigned int> indices;
+        float acmrBefore = 0.0f, acmrAfter = 0.0f; // of optimizeIndices(), 0 if it didn't run
+    };
+
+    bool optimize;
+    Staging staging;
+    // written by the loading thread, read by hostMemoryBytes()
+    std::atomic<size_t> loadingBytes{0};
+
+    void load(const std::string& path);
+    void build(const std::string& cacheSource = "");
+    void fromCache(std::unique_ptr<MeshCache> cache);
+    void upload();
+    void optimizeIndices();
 };
 
 /*****************************************************************************/
@@ -102,40 +215,140 @@ namespace ogl {
         GLuint texNs;
     };
 
+    /* Part of a Model. Holds no GL objects: meshes are built, moved and
+     * destroyed on loader threads, the model owns the buffers */
     class Mesh {
     public:
         Mesh(const std::vector<glm::vec3>& vertices,
              const std::vector<glm::vec2>& uvs,
              const std::vector<glm::vec3>& normals,
-             const Material& mtl);
-        Mesh(const Mesh&) = delete;
-        Mesh(Mesh&& other);
-        ~Mesh();
-        void bind();
+             const Material& mtl,
+             int materialId = -1);
+        /* Bind the VAO of the model before calling draw */
         void draw(int mode = GL_TRIANGLES);
+        void drawLOD(int level, int mode = GL_TRIANGLES);
+        /* Frees the arrays residency does not keep. Freed arrays don't come back */
+        void release(Residency residency);
+        /* Heap bytes of the arrays still held */
+        size_t hostMemoryBytes() const;
     public:
         std::vector<glm::vec3> vertices, normals, indexedVertices, indexedNormals;
         std::vector<glm::vec2> uvs, indexedUVS;
-        std::vector<unsigned int> indices;
+        std::vector<unsigned int> indices; // level 0
+        /* Level 0 is the full mesh. Ranges in the element buffer of the model,
+         * the indices of all levels are relative to baseVertex */
+        std::vector<LODRange> lods;
+        GLint baseVertex = 0;
         Material mtl;
-        GLuint VAO, verticesVBO, uvsVBO, normalsVBO, elementVBO;
+        int materialId; // of the OBJ, -1 without material
+        /* Model space bounds, computed at load time */
+        glm::vec3 boundsMin, boundsMax, center;
+        float radius;
+        // all levels, until the model merges them into its element buffer
+        std::vector<unsigned int> lodIndices;
     private:
-        void createContext();
+        void prepare();
+        void computeBounds();
+    };
+
+    /* Meshes [firstMesh, firstMesh + meshCount) of a Model share this material */
+    struct MaterialGroup {
+        unsigned int firstMesh, meshCount;
+    };
+
+    /**
+    * Node of the bounding volume hierarchy over the meshes of a Model, stored
+    * depth first so that the left child of an inner node is the next node.
+    * 32 bytes, two nodes per cache line.
+    */
+    struct BVHNode {
+        glm::vec3 min;
+        unsigned int skipOrFirst; // inner: node after the subtree, leaf: first entry of bvhMeshes
+        glm::vec3 max;
+        unsigned int count;       // meshes of a leaf, 0 for inner nodes
     };
 
+    /**
+    * Meshes of an OBJ, one per shape, merged into one vertex and element
+    * buffer and sorted by material. A draw issues one
+    * glMultiDrawElementsBaseVertex per material with visible meshes.
+    */
     class Model {
     public:
         using MTLUploadFunction = void(const Material&);
-        Model(std::string path, MTLUploadFunction* uploader = nullptr);
+        /* With a loader the model is parsed on a worker and has no meshes
+         * before isLoaded(), its textures are streamed. loader must outlive the load.
+         * Textures come from assets if given, shared with the other users of the files.
+         * residency applies to every mesh once uploaded */
+        Model(std::string path, MTLUploadFunction* uploader = nullptr, VertexFormat format = VERTEX_FLOAT,
+              AsyncLoader* loader = nullptr, AssetRegistry* assets = nullptr,
+              Residency residency = RESIDENCY_KEEP);
+        Model(const Model&) = delete;
         ~Model();
         void draw();
+        /* Draw only the meshes whose bounds intersect the frustum of PV (model space),
+         * each at the level of detail of selector if given (camera in model space) */
+        void draw(const glm::mat4& PV, const LODSelector* selector = nullptr);
+        bool isLoaded() const { return loaded; }
+        int lastDrawnMeshes() const { return drawnMeshes; }
+        int lastDrawCalls() const { return drawCalls; }
+        int meshCount() const { return (int) meshes.size(); }
+        const std::vector<Mesh>& getMeshes() const { return meshes; }
+        const std::vector<MaterialGroup>& getMaterialGroups() const { return groups; }
+        /* Frees the mesh arrays residency does not keep, now and for meshes still loading.
+         * Freed arrays don't come back */
+        void setResidency(Residency residency);
+        Residency getResidency() const { return residency; }
+        /* Heap bytes of the meshes and the BVH, and of a background load still running */
+        size_t hostMemoryBytes() const;
+    public:
+        // interleaved in format, one quantization for all meshes
+        GLuint VAO = 0, vertexVBO = 0, elementVBO = 0;
+        VertexQuantization quantization;
     private:
+        static const unsigned int MAX_LEAF_MESHES = 2;
+
+        // meshes before upload, with the texture files of their material (Ka, Kd, Ks, Ns),
+        // and the merged buffer contents
+        struct ParsedOBJ {
+            std::vector<Mesh> meshes;
+            std::vector<std::array<std::string, 4>> textureNames;
+            std::vector<MaterialGroup> groups;
+            std::vector<uint8_t> vertices;
+            std::vector<unsigned int> indices;
+            VertexQuantization quantization;
+            bool hasNormals = false, hasUVs = false;
+        };
+
         std::vector<Mesh> meshes;
-        std::map<std::string, GLuint> textures;
+        std::vector<MaterialGroup> groups;
+        std::vector<BVHNode> bvh;
+        std::vector<unsigned int> bvhMeshes;
+        std::map<std::string, std::shared_ptr<const TextureAsset>> textures;
         MTLUploadFunction* uploadFunction;
+        AssetRegistry* assets;
+        VertexFormat format;
+        Residency residency;
+        int drawnMeshes, drawCalls;
+        bool loaded;
+        // of the ParsedOBJ of a background load, written by the worker
+        std::atomic<size_t> pendingBytes{0};
+        // per draw: level of each mesh (-1 culled) and the arguments of a multi draw
+        std::vector<int> meshLevels;
+        std::vector<GLsizei> drawCounts;
+        std::vector<void*> drawOffsets;
+        std::vector<GLint> drawBaseVertices;
     private:
-        void loadOBJWithTiny(const std::string& filename);
-        void loadTexture(const std::string& filename);
+        static ParsedOBJ parseOBJ(const std::string& filename);
+        /* Sorts the meshes by material and packs them into the buffers of parsed */
+        static void merge(ParsedOBJ& parsed, VertexFormat format);
+        static size_t parsedBytes(const ParsedOBJ& parsed);
+        void finishLoading(ParsedOBJ& parsed, AsyncLoader* loader);
+        GLuint loadTexture(const std::string& filename, AsyncLoader* loader);
+        /* One multi draw per material group, of the meshes with a level in meshLevels */
+        void drawGroups();
+        void buildBVH();
+        void buildBVHNode(unsigned int begin, unsigned int end);
     };
 }
 
@@ -233,4 +233,8 @@ GLuint loadSOIL(const char* imagePath) {
     }
 
     return texture;
-}
\ No newline at end of file
+}
+
+TextureAsset::~TextureAsset() {
+    glDeleteTextures(1, &name);
+}
@@ -28,4 +28,17 @@ GLuint loadDDS(const char* imagePath);
 */
 GLuint loadSOIL(const char* imagePath);
 
+/**
+* A texture owned by the handles to it, deleted with the last one.
+* See AssetRegistry.
+*/
+struct TextureAsset {
+    GLuint name;
+
+    explicit TextureAsset(GLuint name) : name(name) {}
+    ~TextureAsset();
+    TextureAsset(const TextureAsset&) = delete;
+    TextureAsset& operator=(const TextureAsset&) = delete;
+};
+
 #endif
\ No newline at end of file